@@ -0,0 +1,544 @@
+#include "aruco_detector.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+static const DictName kDictNames[] = {
+    {"DICT_4X4_50", cv::aruco::DICT_4X4_50, 50},       {"DICT_4X4_100", cv::aruco::DICT_4X4_100, 100},
+    {"DICT_4X4_250", cv::aruco::DICT_4X4_250, 250},    {"DICT_4X4_1000", cv::aruco::DICT_4X4_1000, 1000},
+    {"DICT_5X5_50", cv::aruco::DICT_5X5_50, 50},       {"DICT_5X5_100", cv::aruco::DICT_5X5_100, 100},
+    {"DICT_5X5_250", cv::aruco::DICT_5X5_250, 250},    {"DICT_5X5_1000", cv::aruco::DICT_5X5_1000, 1000},
+    {"DICT_6X6_50", cv::aruco::DICT_6X6_50, 50},       {"DICT_6X6_100", cv::aruco::DICT_6X6_100, 100},
+    {"DICT_6X6_250", cv::aruco::DICT_6X6_250, 250},    {"DICT_6X6_1000", cv::aruco::DICT_6X6_1000, 1000},
+    {"DICT_7X7_50", cv::aruco::DICT_7X7_50, 50},       {"DICT_7X7_100", cv::aruco::DICT_7X7_100, 100},
+    {"DICT_7X7_250", cv::aruco::DICT_7X7_250, 250},    {"DICT_7X7_1000", cv::aruco::DICT_7X7_1000, 1000},
+    {"DICT_ARUCO_ORIGINAL", cv::aruco::DICT_ARUCO_ORIGINAL, 1024},
+    {"DICT_APRILTAG_16h5", cv::aruco::DICT_APRILTAG_16h5, 30},
+    {"DICT_APRILTAG_25h9", cv::aruco::DICT_APRILTAG_25h9, 35},
+    {"DICT_APRILTAG_36h10", cv::aruco::DICT_APRILTAG_36h10, 2320},
+    {"DICT_APRILTAG_36h11", cv::aruco::DICT_APRILTAG_36h11, 587},
+};
+static const int kNumDictNames = (int)(sizeof(kDictNames) / sizeof(kDictNames[0]));
+
+const DictName* findDictName(const std::string& name) {
+    for (const DictName& d : kDictNames)
+        if (name == d.name) return &d;
+    return nullptr;
+}
+
+const DictName* findDictName(int id) {
+    for (const DictName& d : kDictNames)
+        if (d.id == id) return &d;
+    return nullptr;
+}
+
+std::vector<DecodeDictionary> makeDecodeDictionaries(const std::vector<int>& dictIds) {
+    std::vector<DecodeDictionary> out;
+    for (int d : dictIds) {
+        DecodeDictionary dd;
+        dd.dict = cv::aruco::getPredefinedDictionary(d);
+        dd.tag = d;
+        dd.decoder = HammingDecoder::create(*dd.dict);
+        out.push_back(dd);
+    }
+    return out;
+}
+
+cv::Ptr<cv::aruco::DetectorParameters> defaultDetectorParameters() {
+    cv::Ptr<cv::aruco::DetectorParameters> p = cv::aruco::DetectorParameters::create();
+    p->adaptiveThreshWinSizeMin = 3;
+    p->adaptiveThreshWinSizeMax = 23;
+    p->adaptiveThreshWinSizeStep = 10;
+    p->minMarkerPerimeterRate = 0.01f; // detect smaller markers
+    p->maxMarkerPerimeterRate = 4.0f;
+    p->polygonalApproxAccuracyRate = 0.05;
+    return p;
+}
+
+// ---- ID registry ----
+std::shared_ptr<const IdRegistry> IdRegistry::builtin(const std::vector<int>& activeDicts) {
+    std::shared_ptr<IdRegistry> reg(new IdRegistry(activeDicts));
+    reg->allow(cv::aruco::DICT_6X6_50, 3, "Three's Company");
+    reg->allow(cv::aruco::DICT_6X6_50, 7, "Lucky Number Seven");
+    return reg;
+}
+
+std::shared_ptr<const IdRegistry> IdRegistry::load(const std::string& path, const std::vector<int>& activeDicts,
+                                                   std::string& error) {
+    std::ifstream in(path.c_str());
+    if (!in) {
+        error = "无法打开 ID 配置文件 " + path;
+        return nullptr;
+    }
+    std::shared_ptr<IdRegistry> reg(new IdRegistry(activeDicts));
+    std::string line;
+    for (int lineNo = 1; std::getline(in, line); ++lineNo) {
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        std::istringstream ss(line);
+        std::string dictName, range, label;
+        if (!(ss >> dictName)) continue; // blank or comment
+        const DictName* d = findDictName(dictName);
+        int first = -1, last = -1;
+        char dash = 0;
+        ss >> range;
+        std::getline(ss >> std::ws, label);
+        while (!label.empty() && std::isspace((unsigned char)label.back())) label.pop_back();
+        int fields = std::sscanf(range.c_str(), "%d%c%d", &first, &dash, &last);
+        if (fields == 1) last = first;
+        const std::string where = cv::format("%s 第 %d 行: ", path.c_str(), lineNo);
+        if (!d) {
+            error = where + "未知字典 " + dictName;
+            return nullptr;
+        }
+        if ((fields != 1 && (fields != 3 || dash != '-')) || first < 0 || last < first || last >= d->size) {
+            error = where + cv::format("无效的 ID '%s' (%s 的 ID 范围为 0-%d)", range.c_str(), d->name, d->size - 1);
+            return nullptr;
+        }
+        for (int id = first; id <= last; ++id)
+            reg->allow(d->id, id, label.empty() ? cv::format("ID_%d", id) : label);
+    }
+    return reg;
+}
+
+IdRegistry::IdRegistry(const std::vector<int>& activeDicts)
+    : tables_(kNumDictNames), tagDicts_(activeDicts.size() > 1) {
+    for (int d : activeDicts) ensureTable(d);
+}
+
+const std::string& IdRegistry::unknown() {
+    static const std::string kUnknown("Wrong_ID");
+    return kUnknown;
+}
+
+IdRegistry::Table* IdRegistry::ensureTable(int dict) {
+    const DictName* d = findDictName(dict);
+    if (!d || (unsigned)dict >= tables_.size()) return nullptr;
+    Table& t = tables_[dict];
+    if (t.size == 0) {
+        t.size = d->size;
+        t.bits.assign((d->size + 63) / 64, 0);
+        t.labels.resize(d->size);
+        t.idTexts.resize(d->size);
+        // With several dictionaries active the id text names its dictionary
+        for (int i = 0; i < d->size; ++i) {
+            t.labels[i] = cv::format("Wrong_ID_%d", i);
+            t.idTexts[i] = tagDicts_ ? cv::format("%s id=%d", d->name + 5, i) : cv::format("id=%d", i);
+        }
+    }
+    return &t;
+}
+
+void IdRegistry::allow(int dict, int id, const std::string& label) {
+    Table* t = ensureTable(dict);
+    if (!t || id < 0 || id >= t->size) return;
+    uint64_t& word = t->bits[id >> 6];
+    const uint64_t bit = (uint64_t)1 << (id & 63);
+    if (!(word & bit)) ++allowedCount_;
+    word |= bit;
+    t->labels[id] = label;
+}
+// ---- End ID registry ----
+
+// ---- ROI tracking ----
+// Union overlapping windows so no area is searched twice
+static void mergeRoi(std::vector<cv::Rect>& rois, cv::Rect roi) {
+    for (size_t i = 0; i < rois.size();) {
+        if ((rois[i] & roi).area() > 0) {
+            roi |= rois[i];
+            rois.erase(rois.begin() + i);
+            i = 0;
+        } else {
+            ++i;
+        }
+    }
+    rois.push_back(roi);
+}
+
+bool RoiTracker::plan(uint64_t seq, const cv::Size& frameSize, std::vector<cv::Rect>& rois) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    rois.clear();
+    if (!cfg_.enabled || lost_ || tracked_.empty() ||
+        seq >= lastFullSeq_ + (uint64_t)cfg_.fullScanInterval) {
+        lastFullSeq_ = seq;
+        lost_ = false;
+        return false;
+    }
+    const cv::Rect bounds(0, 0, frameSize.width, frameSize.height);
+    for (const auto& pts : tracked_) {
+        cv::Rect box = cv::boundingRect(pts);
+        int pad = std::max(16, (int)(std::max(box.width, box.height) * cfg_.roiMargin));
+        cv::Rect roi(box.x - pad, box.y - pad, box.width + 2 * pad, box.height + 2 * pad);
+        roi &= bounds;
+        if (!roi.empty()) mergeRoi(rois, roi);
+    }
+    return !rois.empty();
+}
+
+void RoiTracker::update(uint64_t seq, const IdRegistry& registry, const Detections& found) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (seq < lastUpdateSeq_) return;
+    lastUpdateSeq_ = seq;
+
+    const std::vector<int>& ids = found.ids;
+    const std::vector<int>& dicts = found.dicts;
+    if (found.fullScan) {
+        // (Re)lock onto every allowed marker visible in the frame
+        trackedIds_.clear();
+        trackedDicts_.clear();
+        tracked_.clear();
+        for (size_t k = 0; k < ids.size(); ++k) {
+            if (registry.allowed(dicts[k], ids[k])) {
+                trackedIds_.push_back(ids[k]);
+                trackedDicts_.push_back(dicts[k]);
+                tracked_.push_back(found.corners[k]);
+            }
+        }
+        return;
+    }
+    // ROI pass: a tracked marker that went missing forces a full scan
+    for (size_t t = 0; t < trackedIds_.size(); ++t) {
+        size_t k = 0;
+        while (k < ids.size() && (ids[k] != trackedIds_[t] || dicts[k] != trackedDicts_[t])) ++k;
+        if (k == ids.size()) { lost_ = true; continue; }
+        tracked_[t] = found.corners[k];
+    }
+}
+
+// Copy src (shifted by off) into slot i of dst, reusing the slot's storage.
+// Slots are only ever appended, so their buffers survive from frame to frame.
+static void storeQuad(std::vector<std::vector<cv::Point2f>>& dst, size_t i,
+                      const std::vector<cv::Point2f>& src, const cv::Point2f& off) {
+    if (dst.size() <= i) dst.resize(i + 1);
+    std::vector<cv::Point2f>& q = dst[i];
+    q.resize(src.size());
+    for (size_t j = 0; j < src.size(); ++j) q[j] = src[j] + off;
+}
+
+// One detectMarkers-equivalent call: the in-tree front end when the worker
+// has one (--fast-detect), otherwise OpenCV's implementation, which only
+// handles a single dictionary. dicts tags are dictionary ids. The candidate
+// counts of the call are added to work.
+static void runDetector(const cv::Mat& image, const std::vector<DecodeDictionary>& dicts,
+                        const cv::Ptr<cv::aruco::DetectorParameters>& params, MarkerFrontEnd* fe,
+                        Detections& out, DetectCounters& work) {
+    if (fe) {
+        const FrontEndTimings& t = fe->timings();
+        const size_t candidates = t.candidates, attempts = t.decodeAttempts;
+        fe->detect(image, dicts, params, out.corners, out.ids, out.dicts, out.rejected);
+        work.candidates += (uint32_t)(t.candidates - candidates);
+        work.decodeAttempts += (uint32_t)(t.decodeAttempts - attempts);
+    } else {
+        cv::aruco::detectMarkers(image, dicts[0].dict, out.corners, out.ids, params, out.rejected);
+        out.dicts.assign(out.ids.size(), dicts[0].tag);
+        const uint32_t candidates = (uint32_t)(out.ids.size() + out.rejected.size());
+        work.candidates += candidates;
+        work.decodeAttempts += candidates;
+    }
+    work.rejected += (uint32_t)out.rejected.size();
+}
+
+// Run the detector on each ROI of image and map the results back to frame coordinates
+static void detectInRois(const cv::Mat& image, const std::vector<cv::Rect>& rois,
+                         const std::vector<DecodeDictionary>& dicts,
+                         const cv::Ptr<cv::aruco::DetectorParameters>& params, MarkerFrontEnd* fe,
+                         Detections& tmp, Detections& out, DetectCounters& work) {
+    out.ids.clear();
+    out.dicts.clear();
+    size_t nCorners = 0, nRejected = 0;
+    for (const cv::Rect& r : rois) {
+        runDetector(image(r), dicts, params, fe, tmp, work);
+        const cv::Point2f off((float)r.x, (float)r.y);
+        for (size_t k = 0; k < tmp.ids.size(); ++k) {
+            out.ids.push_back(tmp.ids[k]);
+            out.dicts.push_back(tmp.dicts[k]);
+            storeQuad(out.corners, nCorners++, tmp.corners[k], off);
+        }
+        for (const auto& quad : tmp.rejected) storeQuad(out.rejected, nRejected++, quad, off);
+    }
+    out.corners.resize(nCorners);
+    out.rejected.resize(nRejected);
+}
+// ---- End ROI tracking ----
+
+// ---- Pyramid (coarse-to-fine) ----
+// Smallest marker side (px) that still yields a usable quad contour on the coarse level
+static const int kMinCoarseMarkerPx = 16;
+static const int kMaxPyramidLevel = 4;
+// Without an expected size, markers are assumed to span at least this share
+// of the frame's long side (60 px at 1080p). The default minMarkerPerimeterRate
+// allows 5 px markers, which would never leave level 0.
+static const double kDefaultMarkerFraction = 1.0 / 32.0;
+
+int choosePyramidLevel(const cv::Size& frameSize, const cv::aruco::DetectorParameters& params,
+                       int expectedMarkerPx) {
+    const int longSide = std::max(frameSize.width, frameSize.height);
+    double minSide = params.minMarkerPerimeterRate * longSide / 4.0;
+    minSide = std::max(minSide, expectedMarkerPx > 0 ? (double)expectedMarkerPx : longSide * kDefaultMarkerFraction);
+    int level = 0;
+    while (level < kMaxPyramidLevel && minSide / (double)(2 << level) >= kMinCoarseMarkerPx) ++level;
+    return level;
+}
+
+// Find candidate quads on a downscaled copy, then decode and refine only the
+// matching windows of the full-resolution frame.
+static void detectPyramid(const cv::Mat& image, int level, const std::vector<DecodeDictionary>& dicts,
+                          const cv::Ptr<cv::aruco::DetectorParameters>& params, MarkerFrontEnd* fe,
+                          PyramidScratch& scratch, Detections& out, DetectCounters& work) {
+    const float scale = (float)(1 << level);
+    cv::resize(image, scratch.coarse, cv::Size(), 1.0 / scale, 1.0 / scale, cv::INTER_AREA);
+    Detections& c = scratch.coarseOut;
+    runDetector(scratch.coarse, dicts, params, fe, c, work);
+
+    // Decoded markers and rejected quads are both worth a full-resolution look:
+    // a marker too small to decode at the coarse level may still decode here.
+    const cv::Rect bounds(0, 0, image.cols, image.rows);
+    scratch.rois.clear();
+    auto addCandidate = [&](const std::vector<cv::Point2f>& quad) {
+        cv::Rect box = cv::boundingRect(quad);
+        // Quads well below the design minimum are background texture
+        if (std::max(box.width, box.height) < kMinCoarseMarkerPx / 2) return;
+        cv::Rect full(cvFloor(box.x * scale), cvFloor(box.y * scale),
+                      cvCeil(box.width * scale), cvCeil(box.height * scale));
+        int pad = std::max((int)(2 * scale), std::max(full.width, full.height) / 4);
+        full = cv::Rect(full.x - pad, full.y - pad, full.width + 2 * pad, full.height + 2 * pad) & bounds;
+        if (!full.empty()) mergeRoi(scratch.rois, full);
+    };
+    for (const auto& quad : c.corners) addCandidate(quad);
+    for (const auto& quad : c.rejected) addCandidate(quad);
+
+    detectInRois(image, scratch.rois, dicts, params, fe, scratch.coarseOut, out, work);
+}
+// ---- End pyramid ----
+
+void detectFrame(const DetectionContext& ctx, const cv::Mat& image, int camera, uint64_t seq,
+                 const IdRegistry& registry, DetectScratch& scratch, Detections& out) {
+    const CameraDetectState& cam = ctx.cameras[camera];
+    const cv::Ptr<cv::aruco::DetectorParameters> params = ctx.liveParams ? ctx.liveParams->get() : ctx.params;
+    MarkerFrontEnd* fe = ctx.fastFrontEnd ? &scratch.frontEnd : nullptr;
+    if (fe) fe->setOpenCL(ctx.openCL);
+    DetectCounters work;
+    out.fullScan = !cam.tracker || !cam.tracker->plan(seq, image.size(), scratch.rois);
+    if (!out.fullScan)
+        detectInRois(image, scratch.rois, ctx.dicts, params, fe, scratch.roiOut, out, work);
+    else if (cam.pyramidLevel > 0)
+        detectPyramid(image, cam.pyramidLevel, ctx.dicts, params, fe, scratch.pyr, out, work);
+    else
+        runDetector(image, ctx.dicts, params, fe, out, work);
+    for (size_t i = 0; i < out.ids.size(); ++i) {
+        if (registry.allowed(out.dicts[i], out.ids[i])) ++work.accepted;
+        else ++work.wrong;
+    }
+    out.counters = work;
+    if (cam.tracker) cam.tracker->update(seq, registry, out);
+}
+
+// ---- Detector ----
+// Defaults filled in, then the checks both detectors share. Null and error
+// set when the configuration is unusable.
+static std::shared_ptr<const IdRegistry> prepareConfig(DetectorConfig& c, std::string& error) {
+    if (c.dictionaries.empty()) c.dictionaries.push_back(cv::aruco::DICT_6X6_50);
+    for (int d : c.dictionaries) {
+        if (!findDictName(d)) {
+            error = cv::format("未知字典 %d", d);
+            return nullptr;
+        }
+    }
+    if (!c.params) c.params = defaultDetectorParameters();
+    return c.idsPath.empty() ? IdRegistry::builtin(c.dictionaries) : IdRegistry::load(c.idsPath, c.dictionaries, error);
+}
+
+static void buildContext(const DetectorConfig& c, DetectionContext& ctx) {
+    ctx.dicts = makeDecodeDictionaries(c.dictionaries);
+    ctx.params = c.params;
+    // detectMarkers decodes a single dictionary; the in-tree front end decodes
+    // many and has the OpenCL threshold. Without a device the CPU kernels run.
+    ctx.openCL = c.openCL && !openclDevice().empty();
+    ctx.fastFrontEnd = c.fastFrontEnd || c.dictionaries.size() > 1 || ctx.openCL;
+}
+
+static void toDetections(const Detections& found, const IdRegistry& registry, std::vector<Detection>& out) {
+    out.resize(found.ids.size());
+    for (size_t i = 0; i < out.size(); ++i) {
+        Detection& d = out[i];
+        d.dict = found.dicts[i];
+        d.id = found.ids[i];
+        d.allowed = registry.allowed(d.dict, d.id);
+        for (int j = 0; j < 4; ++j) d.corners[j] = found.corners[i][j];
+    }
+}
+
+std::unique_ptr<Detector> Detector::create(const DetectorConfig& cfg, std::string& error) {
+    DetectorConfig c = cfg;
+    std::shared_ptr<const IdRegistry> registry = prepareConfig(c, error);
+    if (!registry) return nullptr;
+    std::unique_ptr<Detector> det(new Detector(c));
+    det->registry_ = std::move(registry);
+    return det;
+}
+
+Detector::Detector(const DetectorConfig& cfg) : tracker_(cfg.tracker), pyrCfg_(cfg.pyramid) {
+    buildContext(cfg, ctx_);
+    ctx_.cameras.resize(1);
+    if (cfg.tracker.enabled) ctx_.cameras[0].tracker = &tracker_;
+}
+
+void Detector::detect(const cv::Mat& image, std::vector<Detection>& out) {
+    CV_Assert(image.depth() == CV_8U && (image.channels() == 1 || image.channels() == 3));
+    if (image.channels() == 1) {
+        run(image, out);
+        return;
+    }
+    cv::cvtColor(image, gray_, cv::COLOR_BGR2GRAY);
+    run(gray_, out);
+}
+
+void Detector::detect(const uint8_t* data, int width, int height, size_t stride, std::vector<Detection>& out) {
+    run(cv::Mat(height, width, CV_8UC1, const_cast<uint8_t*>(data), stride), out);
+}
+
+void Detector::run(const cv::Mat& gray, std::vector<Detection>& out) {
+    if (gray.size() != frameSize_) {
+        frameSize_ = gray.size();
+        ctx_.cameras[0].pyramidLevel =
+            pyrCfg_.enabled ? choosePyramidLevel(frameSize_, *ctx_.params, pyrCfg_.expectedMarkerPx) : 0;
+    }
+    detectFrame(ctx_, gray, 0, seq_++, *registry_, scratch_, last_);
+    toDetections(last_, *registry_, out);
+}
+// ---- End Detector ----
+
+// ---- Batch detector ----
+std::unique_ptr<BatchDetector> BatchDetector::create(const DetectorConfig& cfg, int threads, std::string& error) {
+    DetectorConfig c = cfg;
+    std::shared_ptr<const IdRegistry> registry = prepareConfig(c, error);
+    if (!registry) return nullptr;
+    if (threads <= 0) threads = (int)std::max(1u, std::thread::hardware_concurrency());
+    std::unique_ptr<BatchDetector> det(new BatchDetector(c, threads));
+    det->registry_ = std::move(registry);
+    return det;
+}
+
+BatchDetector::BatchDetector(const DetectorConfig& cfg, int threads) : pyrCfg_(cfg.pyramid) {
+    buildContext(cfg, ctx_);
+    for (int i = 0; i < threads; ++i) workers_.emplace_back(new Worker);
+    // The calling thread is worker 0
+    for (int i = 1; i < threads; ++i) threads_.emplace_back(&BatchDetector::threadMain, this, (size_t)i);
+}
+
+BatchDetector::~BatchDetector() {
+    {
+        std::lock_guard<std::mutex> lock(batchMutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& t : threads_) t.join();
+}
+
+void BatchDetector::detect(const std::vector<cv::Mat>& images, std::vector<std::vector<Detection>>& results) {
+    const size_t n = images.size();
+    results.resize(n);
+    if (n == 0) return;
+
+    // One size class per distinct frame size, with its pyramid level worked
+    // out once; detectFrame sees them as cameras without a tracker
+    sizeClass_.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        const cv::Size size = images[i].size();
+        size_t k = 0;
+        while (k < sizes_.size() && sizes_[k] != size) ++k;
+        if (k == sizes_.size()) {
+            sizes_.push_back(size);
+            CameraDetectState cam;
+            cam.pyramidLevel =
+                pyrCfg_.enabled ? choosePyramidLevel(size, *ctx_.params, pyrCfg_.expectedMarkerPx) : 0;
+            ctx_.cameras.push_back(cam);
+        }
+        sizeClass_[i] = (int)k;
+    }
+
+    // Contiguous share per worker; whoever runs dry steals from the others
+    const size_t w = workers_.size(), share = (n + w - 1) / w;
+    for (size_t i = 0; i < w; ++i) {
+        Worker& wk = *workers_[i];
+        std::lock_guard<std::mutex> lock(wk.mutex);
+        wk.next = std::min(n, i * share);
+        wk.end = std::min(n, (i + 1) * share);
+    }
+    {
+        std::lock_guard<std::mutex> lock(batchMutex_);
+        images_ = &images;
+        results_ = &results;
+        error_ = nullptr;
+        busy_ = threads_.size();
+        ++generation_;
+    }
+    wake_.notify_all();
+    work(0);
+
+    std::unique_lock<std::mutex> lock(batchMutex_);
+    done_.wait(lock, [this] { return busy_ == 0; });
+    images_ = nullptr;
+    results_ = nullptr;
+    if (error_) std::rethrow_exception(error_);
+}
+
+void BatchDetector::threadMain(size_t self) {
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(batchMutex_);
+            wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_) return;
+            seen = generation_;
+        }
+        work(self);
+        std::lock_guard<std::mutex> lock(batchMutex_);
+        if (--busy_ == 0) done_.notify_one();
+    }
+}
+
+// Own share from the front, then single frames from the back of the others
+bool BatchDetector::take(size_t self, size_t& index) {
+    const size_t w = workers_.size();
+    for (size_t k = 0; k < w; ++k) {
+        Worker& victim = *workers_[(self + k) % w];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.next == victim.end) continue;
+        index = k == 0 ? victim.next++ : --victim.end;
+        return true;
+    }
+    return false;
+}
+
+void BatchDetector::work(size_t self) {
+    Worker& wk = *workers_[self];
+    size_t index;
+    while (take(self, index)) {
+        const cv::Mat& image = (*images_)[index];
+        std::vector<Detection>& out = (*results_)[index];
+        try {
+            if (image.empty()) {
+                out.clear();
+                continue;
+            }
+            CV_Assert(image.depth() == CV_8U && (image.channels() == 1 || image.channels() == 3));
+            const cv::Mat* gray = &image;
+            if (image.channels() == 3) {
+                cv::cvtColor(image, wk.gray, cv::COLOR_BGR2GRAY);
+                gray = &wk.gray;
+            }
+            detectFrame(ctx_, *gray, sizeClass_[index], 0, *registry_, wk.scratch, wk.found);
+            toDetections(wk.found, *registry_, out);
+        } catch (...) {
+            // The first failure is rethrown by detect(); the rest of the batch still runs
+            out.clear();
+            std::lock_guard<std::mutex> lock(batchMutex_);
+            if (!error_) error_ = std::current_exception();
+        }
+    }
+}
+// ---- End batch detector ----
@@ -0,0 +1,338 @@
+// Marker detection without capture or GUI (libarucodet): dictionaries, the
+// ID allow-list, ROI tracking, the coarse-to-fine pyramid scan and the
+// Detector class that bundles them for in-process use. The demo's worker
+// pool drives the same pieces through detectFrame.
+
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/aruco.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "marker_frontend.hpp"
+
+// Predefined dictionaries as named in ID config files and on the command line
+struct DictName {
+    const char* name;
+    int id;   // cv::aruco::PREDEFINED_DICTIONARY_NAME
+    int size; // number of marker IDs
+};
+
+const DictName* findDictName(const std::string& name);
+const DictName* findDictName(int id);
+
+// Predefined dictionaries with their decode tables, tagged with their ids
+std::vector<DecodeDictionary> makeDecodeDictionaries(const std::vector<int>& dictIds);
+
+// Slightly relaxed for better recall on small markers
+cv::Ptr<cv::aruco::DetectorParameters> defaultDetectorParameters();
+
+// Immutable allow-list with every overlay string formatted up front. Lookups
+// are a bounds check plus a bit test or array index per (dictionary, id).
+class IdRegistry {
+public:
+    bool allowed(int dict, int id) const {
+        const Table* t = table(dict);
+        return t && (unsigned)id < (unsigned)t->size && ((t->bits[id >> 6] >> (id & 63)) & 1);
+    }
+    const std::string& label(int dict, int id) const {
+        const Table* t = table(dict);
+        return t && (unsigned)id < (unsigned)t->size ? t->labels[id] : unknown();
+    }
+    const std::string& idText(int dict, int id) const {
+        const Table* t = table(dict);
+        return t && (unsigned)id < (unsigned)t->size ? t->idTexts[id] : unknown();
+    }
+    size_t allowedCount() const { return allowedCount_; }
+
+    // The demo's historical allow-list: IDs 3 and 7 of DICT_6X6_50
+    static std::shared_ptr<const IdRegistry> builtin(const std::vector<int>& activeDicts);
+
+    // Config lines: "<DICT_NAME> <ID>|<FIRST>-<LAST> [label]", '#' starts a
+    // comment. IDs without a label show as "ID_<n>". Returns null and sets
+    // error on the first bad line.
+    static std::shared_ptr<const IdRegistry> load(const std::string& path, const std::vector<int>& activeDicts,
+                                                  std::string& error);
+
+private:
+    struct Table {
+        int size = 0;
+        std::vector<uint64_t> bits;
+        std::vector<std::string> labels;
+        std::vector<std::string> idTexts;
+    };
+
+    explicit IdRegistry(const std::vector<int>& activeDicts);
+
+    static const std::string& unknown();
+
+    const Table* table(int dict) const {
+        if ((unsigned)dict >= tables_.size() || tables_[dict].size == 0) return nullptr;
+        return &tables_[dict];
+    }
+
+    Table* ensureTable(int dict);
+    void allow(int dict, int id, const std::string& label);
+
+    std::vector<Table> tables_; // indexed by dictionary id
+    bool tagDicts_;
+    size_t allowedCount_ = 0;
+};
+
+// Work done on one image, summed over every pass (coarse, ROI and full scans).
+// Cheap enough to fill on every frame.
+struct DetectCounters {
+    uint32_t candidates = 0;     // quads handed to decoding
+    uint32_t rejected = 0;       // candidates that did not decode
+    uint32_t decodeAttempts = 0; // bit samplings; detectMarkers counts one per candidate
+    uint32_t accepted = 0;       // decoded and allowed by the registry
+    uint32_t wrong = 0;          // decoded but not allowed: misreads or foreign markers
+};
+
+// Markers found in one image. ids, dicts and corners are parallel; dicts
+// holds the dictionary id of each marker.
+struct Detections {
+    bool fullScan = true; // false when only tracker ROIs were searched
+    std::vector<int> ids;
+    std::vector<int> dicts;
+    std::vector<std::vector<cv::Point2f>> corners;
+    std::vector<std::vector<cv::Point2f>> rejected;
+    DetectCounters counters;
+
+    void swap(Detections& o) {
+        std::swap(fullScan, o.fullScan);
+        std::swap(counters, o.counters);
+        ids.swap(o.ids);
+        dicts.swap(o.dicts);
+        corners.swap(o.corners);
+        rejected.swap(o.rejected);
+    }
+};
+
+struct TrackerConfig {
+    bool enabled = false;
+    int fullScanInterval = 15; // frames between forced full-frame scans
+    float roiMargin = 0.5f;    // ROI growth per side, as a fraction of marker size
+};
+
+// Remembers where the allowed markers were last seen so that frames in between
+// periodic full scans only search small windows around them. Shared by all
+// detection workers; results arriving out of order are ignored.
+class RoiTracker {
+public:
+    explicit RoiTracker(const TrackerConfig& cfg) : cfg_(cfg) {}
+
+    // Returns true and fills rois when frame seq may be searched locally,
+    // false when it needs a full-frame scan.
+    bool plan(uint64_t seq, const cv::Size& frameSize, std::vector<cv::Rect>& rois);
+
+    // Record the markers found in frame seq; full scans lock onto the ones
+    // registry allows.
+    void update(uint64_t seq, const IdRegistry& registry, const Detections& found);
+
+private:
+    TrackerConfig cfg_;
+    std::mutex mutex_;
+    std::vector<int> trackedIds_;
+    std::vector<int> trackedDicts_;
+    std::vector<std::vector<cv::Point2f>> tracked_;
+    uint64_t lastFullSeq_ = 0;
+    uint64_t lastUpdateSeq_ = 0;
+    bool lost_ = false;
+};
+
+struct PyramidConfig {
+    bool enabled = false;
+    int expectedMarkerPx = 0; // smallest expected marker side at full resolution (0 = 1/32 of the long side)
+};
+
+// Pick how many times the frame can be halved before the smallest marker we
+// must find gets too small to yield a quad. The smallest marker is the
+// caller's expected size, or 1/32 of the long side when that is 0, and never
+// below what minMarkerPerimeterRate allows. 0 means the pyramid cannot help.
+int choosePyramidLevel(const cv::Size& frameSize, const cv::aruco::DetectorParameters& params,
+                       int expectedMarkerPx);
+
+// Detector parameters that may be replaced while workers run. Workers take a
+// reference per frame; a replacement never mutates a Ptr they already hold.
+class SharedDetectorParams {
+public:
+    explicit SharedDetectorParams(const cv::Ptr<cv::aruco::DetectorParameters>& p) : params_(p) {}
+    cv::Ptr<cv::aruco::DetectorParameters> get() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return params_;
+    }
+    void set(const cv::Ptr<cv::aruco::DetectorParameters>& p) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        params_ = p;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    cv::Ptr<cv::aruco::DetectorParameters> params_;
+};
+
+// Detection state that differs per camera
+struct CameraDetectState {
+    int pyramidLevel = 0;
+    RoiTracker* tracker = nullptr;
+};
+
+// Everything a detection worker needs, shared read-only between workers
+struct DetectionContext {
+    std::vector<DecodeDictionary> dicts;  // tagged with dictionary ids; more than one needs fastFrontEnd
+    cv::Ptr<cv::aruco::DetectorParameters> params;
+    SharedDetectorParams* liveParams = nullptr; // overrides params when set (auto-tuning)
+    bool fastFrontEnd = false;                  // in-tree threshold/contour front end
+    bool openCL = false;                        // its threshold stage on the OpenCL device
+    std::vector<CameraDetectState> cameras; // indexed by camera
+};
+
+// Per-worker buffers for the pyramid scan, reused across frames
+struct PyramidScratch {
+    cv::Mat coarse;
+    Detections coarseOut; // coarse candidates, then reused for the ROI passes
+    std::vector<cv::Rect> rois;
+};
+
+// Per-worker buffers reused across frames
+struct DetectScratch {
+    std::vector<cv::Rect> rois;
+    Detections roiOut;
+    PyramidScratch pyr;
+    MarkerFrontEnd frontEnd;
+};
+
+// Detect markers in image (8-bit gray or BGR) from frame seq of camera into out,
+// choosing between a tracker ROI pass, a pyramid scan and a plain full scan.
+// registry decides which markers the tracker follows.
+void detectFrame(const DetectionContext& ctx, const cv::Mat& image, int camera, uint64_t seq,
+                 const IdRegistry& registry, DetectScratch& scratch, Detections& out);
+
+struct DetectorConfig {
+    std::vector<int> dictionaries;                 // predefined dictionary ids; empty = DICT_6X6_50
+    cv::Ptr<cv::aruco::DetectorParameters> params; // null = defaultDetectorParameters()
+    bool fastFrontEnd = false;                     // forced on with several dictionaries or openCL
+    bool openCL = false;                           // threshold on the OpenCL device when there is one
+    std::string idsPath;                           // allow-list file; empty = IdRegistry::builtin
+    TrackerConfig tracker;
+    PyramidConfig pyramid;
+};
+
+struct Detection {
+    int dict;               // predefined dictionary id
+    int id;
+    bool allowed;           // on the allow-list
+    cv::Point2f corners[4]; // clockwise from the marker origin
+};
+
+// One camera's detector: parameters, dictionaries, allow-list, tracker and
+// every buffer a frame needs, reused from call to call. Not thread-safe and
+// stateful when tracking: one instance per camera or thread.
+class Detector {
+public:
+    // Null and error set on an unknown dictionary or a bad ID file
+    static std::unique_ptr<Detector> create(const DetectorConfig& cfg, std::string& error);
+
+    // 8-bit gray is searched in place; BGR is converted into a reused buffer
+    void detect(const cv::Mat& image, std::vector<Detection>& out);
+    // Caller-owned 8-bit luma plane (e.g. the Y plane of NV12), not copied
+    void detect(const uint8_t* data, int width, int height, size_t stride, std::vector<Detection>& out);
+
+    // Full result of the last call, rejected candidates included
+    const Detections& last() const { return last_; }
+
+    const IdRegistry& registry() const { return *registry_; }
+    // Takes effect on the next call, e.g. after IdRegistry::load of an edited file
+    void setRegistry(std::shared_ptr<const IdRegistry> registry) { registry_ = std::move(registry); }
+
+    // False when openCL was asked for but no device was found
+    bool usingOpenCL() const { return ctx_.openCL; }
+
+    Detector(const Detector&) = delete;
+    Detector& operator=(const Detector&) = delete;
+
+private:
+    explicit Detector(const DetectorConfig& cfg);
+    void run(const cv::Mat& gray, std::vector<Detection>& out);
+
+    DetectionContext ctx_;
+    RoiTracker tracker_;
+    PyramidConfig pyrCfg_;
+    std::shared_ptr<const IdRegistry> registry_;
+    DetectScratch scratch_;
+    Detections last_;
+    cv::Mat gray_;
+    cv::Size frameSize_; // pyramid level is chosen again when this changes
+    uint64_t seq_ = 0;
+};
+
+// Throughput mode: whole batches of frames, from any mix of cameras and
+// sizes, spread over a pool of threads that each keep their own buffers.
+// Dictionaries, parameters and per-size pyramid levels are set up once, not
+// per frame. Frames are independent, so there is no ROI tracking. One batch
+// at a time: detect() is not reentrant. OpenCV's thread count is
+// process-wide and left alone; with more than one thread here, call
+// cv::setNumThreads(1) first, or every worker's parallel_for oversubscribes
+// the cores.
+class BatchDetector {
+public:
+    // threads counts the calling thread, which works on every batch too;
+    // 0 = one per hardware thread. Null and error set as for Detector.
+    static std::unique_ptr<BatchDetector> create(const DetectorConfig& cfg, int threads, std::string& error);
+    ~BatchDetector();
+
+    // 8-bit gray or BGR images, not copied. results[i] belongs to images[i];
+    // empty images give empty results. Returns when the whole batch is done
+    // and rethrows the first exception a frame raised.
+    void detect(const std::vector<cv::Mat>& images, std::vector<std::vector<Detection>>& results);
+
+    size_t threads() const { return workers_.size(); }
+    const IdRegistry& registry() const { return *registry_; }
+    // Between batches only
+    void setRegistry(std::shared_ptr<const IdRegistry> registry) { registry_ = std::move(registry); }
+
+    BatchDetector(const BatchDetector&) = delete;
+    BatchDetector& operator=(const BatchDetector&) = delete;
+
+private:
+    // Per-thread buffers plus the part of the batch still queued for it
+    struct Worker {
+        DetectScratch scratch;
+        Detections found;
+        cv::Mat gray;
+        std::mutex mutex; // guards next/end against thieves
+        size_t next = 0, end = 0;
+    };
+
+    BatchDetector(const DetectorConfig& cfg, int threads);
+    void threadMain(size_t self);
+    bool take(size_t self, size_t& index);
+    void work(size_t self);
+
+    DetectionContext ctx_; // cameras[k] is size class k
+    PyramidConfig pyrCfg_;
+    std::shared_ptr<const IdRegistry> registry_;
+    std::vector<cv::Size> sizes_; // size classes seen so far
+    std::vector<int> sizeClass_;  // per frame of the current batch
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+
+    // Current batch, handed to the pool under batchMutex_
+    const std::vector<cv::Mat>* images_ = nullptr;
+    std::vector<std::vector<Detection>>* results_ = nullptr;
+    std::mutex batchMutex_;
+    std::condition_variable wake_, done_;
+    uint64_t generation_ = 0;
+    size_t busy_ = 0; // pool threads still on the current batch
+    bool stop_ = false;
+    std::exception_ptr error_;
+};
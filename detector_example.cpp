@@ -0,0 +1,175 @@
+// libarucodet example and self-check: detects a synthetic frame through every
+// Detector input form (gray in place, BGR, a strided luma plane) and compares
+// each result with detectFrame, the call the demo pipeline makes. Then runs a
+// mixed-size batch through BatchDetector and compares every frame, in order,
+// with Detector. Exit status 1 on any mismatch, or when detection finds too
+// few of the markers the scene placed.
+//
+// Usage: ./detector_example [--fast-detect]     (make check runs both)
+
+#include "aruco_detector.hpp"
+#include "synthetic_scene.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static bool sameCorner(const cv::Point2f& a, const cv::Point2f& b) {
+    return std::abs(a.x - b.x) < 1e-3f && std::abs(a.y - b.y) < 1e-3f;
+}
+
+static bool sameDetections(const std::vector<Detection>& a, const std::vector<Detection>& b) {
+    bool ok = a.size() == b.size();
+    for (size_t i = 0; ok && i < a.size(); ++i) {
+        ok = a[i].dict == b[i].dict && a[i].id == b[i].id && a[i].allowed == b[i].allowed;
+        for (int j = 0; ok && j < 4; ++j) ok = sameCorner(a[i].corners[j], b[i].corners[j]);
+    }
+    return ok;
+}
+
+// out must hold the reference markers in the same order
+static bool matches(const char* form, const Detections& ref, const std::vector<Detection>& out) {
+    bool ok = out.size() == ref.ids.size();
+    for (size_t i = 0; ok && i < out.size(); ++i) {
+        ok = out[i].dict == ref.dicts[i] && out[i].id == ref.ids[i];
+        for (int j = 0; ok && j < 4; ++j) ok = sameCorner(out[i].corners[j], ref.corners[i][j]);
+    }
+    std::cout << form << ": " << out.size() << " markers" << (ok ? "" : "  MISMATCH") << "\n";
+    return ok;
+}
+
+// Placed markers must mostly be found, or a configuration that detects
+// nothing would pass as "0 markers" on every path. The scenes are kept mild
+// (kMinSidePx and up, light blur), so half is a floor that only breaks along
+// with detection itself.
+static const double kMinSidePx = 40.0;
+static bool recallOk(const std::vector<SceneMarker>& truth, int recalled) {
+    return truth.empty() || (recalled > 0 && 2 * recalled >= (int)truth.size());
+}
+
+static int recalledIn(const std::vector<SceneMarker>& truth, const std::vector<Detection>& found) {
+    std::vector<int> dicts, ids;
+    std::vector<std::vector<cv::Point2f>> corners;
+    for (const Detection& d : found) {
+        dicts.push_back(d.dict);
+        ids.push_back(d.id);
+        corners.emplace_back(d.corners, d.corners + 4);
+    }
+    return countRecalled(truth, dicts, ids, corners);
+}
+
+// Frames of two sizes and marker counts, one BGR and one empty, detected in
+// one batch on four threads; results[i] must equal Detector's result for
+// frame i and find enough of its markers
+static bool checkBatch(const DetectorConfig& cfg, Detector& det) {
+    // The pool is the parallelism; OpenCV's own threads would oversubscribe it
+    cv::setNumThreads(1);
+    std::string error;
+    std::unique_ptr<BatchDetector> batch = BatchDetector::create(cfg, 4, error);
+    if (!batch) {
+        std::cerr << error << std::endl;
+        return false;
+    }
+    const cv::Ptr<cv::aruco::Dictionary> dict = cv::aruco::getPredefinedDictionary(cfg.dictionaries[0]);
+    std::vector<cv::Mat> images;
+    std::vector<std::vector<SceneMarker>> truth(25);
+    for (int n = 0; n < 24; ++n) {
+        SceneConfig scfg;
+        scfg.size = n % 2 ? cv::Size(640, 480) : cv::Size(1280, 720);
+        scfg.markers = 1 + n % 8;
+        scfg.minSidePx = kMinSidePx;
+        scfg.maxBlurSigma = 0.6;
+        scfg.seed = 7;
+        SyntheticScene scene(scfg, dict, cfg.dictionaries[0]);
+        cv::Mat frame;
+        scene.render(n, frame, truth[n]);
+        if (n == 5) cv::cvtColor(frame, frame, cv::COLOR_GRAY2BGR);
+        images.push_back(frame);
+    }
+    images.push_back(cv::Mat());
+
+    std::vector<std::vector<Detection>> results;
+    batch->detect(images, results);
+    bool ok = results.size() == images.size();
+    size_t markers = 0, placed = 0, recalled = 0;
+    std::vector<Detection> expected;
+    for (size_t i = 0; ok && i < images.size(); ++i) {
+        expected.clear();
+        if (!images[i].empty()) det.detect(images[i], expected);
+        ok = sameDetections(results[i], expected);
+        if (!ok) {
+            std::cout << "batch frame " << i << ": MISMATCH with Detector\n";
+            break;
+        }
+        const int found = recalledIn(truth[i], results[i]);
+        if (!recallOk(truth[i], found)) {
+            std::cout << "batch frame " << i << ": " << found << " of " << truth[i].size() << " placed  LOW RECALL\n";
+            ok = false;
+        }
+        markers += results[i].size();
+        placed += truth[i].size();
+        recalled += found;
+    }
+    std::cout << "batch: " << images.size() << " frames on " << batch->threads() << " threads, " << markers
+              << " markers, " << recalled << " of " << placed << " placed" << (ok ? "" : "  FAILED") << "\n";
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    DetectorConfig cfg;
+    cfg.dictionaries = {cv::aruco::DICT_6X6_50};
+    for (int a = 1; a < argc; ++a) {
+        if (std::strcmp(argv[a], "--fast-detect") == 0) cfg.fastFrontEnd = true;
+    }
+    std::string error;
+    std::unique_ptr<Detector> det = Detector::create(cfg, error);
+    if (!det) {
+        std::cerr << error << std::endl;
+        return 2;
+    }
+
+    SceneConfig scfg;
+    scfg.markers = 12;
+    scfg.minSidePx = kMinSidePx;
+    scfg.maxBlurSigma = 0.6;
+    SyntheticScene scene(scfg, cv::aruco::getPredefinedDictionary(cfg.dictionaries[0]), cfg.dictionaries[0]);
+    cv::Mat gray;
+    std::vector<SceneMarker> truth;
+    scene.render(0, gray, truth);
+
+    // Reference: the demo's per-frame call with the same configuration
+    DetectionContext ctx;
+    ctx.dicts = makeDecodeDictionaries(cfg.dictionaries);
+    ctx.params = defaultDetectorParameters();
+    ctx.fastFrontEnd = cfg.fastFrontEnd;
+    ctx.cameras.resize(1);
+    DetectScratch scratch;
+    Detections ref;
+    detectFrame(ctx, gray, 0, 0, det->registry(), scratch, ref);
+    const int recalled = countRecalled(truth, ref.dicts, ref.ids, ref.corners);
+    const bool found = recallOk(truth, recalled);
+    std::cout << "detectFrame: " << ref.ids.size() << " markers, " << recalled << " of " << truth.size() << " placed"
+              << (found ? "" : "  LOW RECALL") << "\n";
+
+    bool ok = found;
+    std::vector<Detection> out;
+    det->detect(gray, out);
+    ok &= matches("gray", ref, out);
+
+    cv::Mat bgr;
+    cv::cvtColor(gray, bgr, cv::COLOR_GRAY2BGR);
+    det->detect(bgr, out);
+    ok &= matches("bgr", ref, out);
+
+    // Luma plane inside a wider buffer, as a driver with row padding hands it out
+    const size_t stride = gray.cols + 64;
+    std::vector<uint8_t> plane(stride * gray.rows, 0);
+    for (int y = 0; y < gray.rows; ++y) std::memcpy(&plane[y * stride], gray.ptr<uchar>(y), gray.cols);
+    det->detect(plane.data(), gray.cols, gray.rows, stride, out);
+    ok &= matches("strided luma", ref, out);
+
+    ok &= checkBatch(cfg, *det);
+    return ok ? 0 : 1;
+}
@@ -2,9 +2,24 @@
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/aruco.hpp>
+#include "marker_vector.hpp"
+#include <sys/stat.h>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace cv;
@@ -34,6 +49,45 @@ static const std::vector<DictInfo> kDicts = {
     {"DICT_ARUCO_ORIGINAL", aruco::DICT_ARUCO_ORIGINAL},
 };
 
+// getPredefinedDictionary rebuilds the whole codeword table on every call.
+// Each kDicts entry is built once, on first use or by the startup warm-up
+// thread, whichever comes first, and shared for the rest of the process.
+class DictCache {
+public:
+    static DictCache& instance() {
+        static DictCache cache;
+        return cache;
+    }
+
+    const Ptr<aruco::Dictionary>& get(int idx) {
+        std::call_once(built_[idx], [this, idx]() { dicts_[idx] = aruco::getPredefinedDictionary(kDicts[idx].id); });
+        return dicts_[idx];
+    }
+
+    // Build every entry in the background, outward from index first
+    void warm(int first) {
+        if (warmer_.joinable()) return;
+        warmer_ = std::thread([this, first]() {
+            const int n = (int)kDicts.size();
+            for (int step = 0; step < n; ++step) {
+                int off = (step + 1) / 2;
+                get(((step % 2 ? first + off : first - off) % n + n) % n);
+            }
+        });
+    }
+
+    ~DictCache() {
+        if (warmer_.joinable()) warmer_.join();
+    }
+
+private:
+    DictCache() : built_(new std::once_flag[kDicts.size()]), dicts_(kDicts.size()) {}
+
+    std::unique_ptr<std::once_flag[]> built_;
+    std::vector<Ptr<aruco::Dictionary>> dicts_;
+    std::thread warmer_;
+};
+
 struct State {
     int dictIdx = 8;   // default DICT_6X6_50
     int markerId = 0;
@@ -43,19 +97,18 @@ struct State {
     bool showHelp = true;
 };
 
-static inline Ptr<aruco::Dictionary> currentDictionary(const State& s) {
+static inline const Ptr<aruco::Dictionary>& currentDictionary(const State& s) {
     int idx = std::max(0, std::min((int)kDicts.size() - 1, s.dictIdx));
-    return aruco::getPredefinedDictionary(kDicts[idx].id);
+    return DictCache::instance().get(idx);
 }
 
 static inline int currentDictSize(const State& s) {
-    auto dict = currentDictionary(s);
-    return dict->bytesList.rows; // number of markers available
+    return currentDictionary(s)->bytesList.rows; // number of markers available
 }
 
 static Mat renderMarker(const State& s) {
     Mat img;
-    auto dict = currentDictionary(s);
+    const Ptr<aruco::Dictionary>& dict = currentDictionary(s);
     int maxId = std::max(1, currentDictSize(s)) - 1;
     int id = std::max(0, std::min(maxId, s.markerId));
     int bb = std::max(0, std::min(7, s.borderBits));
@@ -110,54 +163,369 @@ static std::string autoFileName(const State& s) {
                       std::max(50, s.markerSize), std::max(0, std::min(7, s.borderBits)));
 }
 
+// ---- GUI layer helpers ----
+// Padded BGR marker bitmaps for recently viewed settings, bounded by bytes
+// rather than entries: one 4096 px marker alone is tens of MB.
+class MarkerLru {
+public:
+    explicit MarkerLru(size_t maxBytes) : maxBytes_(maxBytes) {}
+
+    // serial identifies the bitmap: equal serials mean identical pixels
+    const Mat& get(const State& s, uint64_t& serial) {
+        const int idx = std::max(0, std::min((int)kDicts.size() - 1, s.dictIdx));
+        const int id = std::max(0, std::min(std::max(1, currentDictSize(s)) - 1, s.markerId));
+        const int ms = std::max(50, s.markerSize);
+        const int bb = std::max(0, std::min(7, s.borderBits));
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->dictIdx == idx && it->id == id && it->size == ms && it->border == bb) {
+                entries_.splice(entries_.begin(), entries_, it);
+                serial = it->serial;
+                return it->bgr;
+            }
+        }
+        Entry e{idx, id, ms, bb, ++nextSerial_, Mat()};
+        cvtColor(renderMarker(s), e.bgr, COLOR_GRAY2BGR);
+        bytes_ += e.bgr.total() * e.bgr.elemSize();
+        entries_.push_front(e);
+        // Never evict the entry just added, however large
+        while (bytes_ > maxBytes_ && entries_.size() > 1) {
+            bytes_ -= entries_.back().bgr.total() * entries_.back().bgr.elemSize();
+            entries_.pop_back();
+        }
+        serial = entries_.front().serial;
+        return entries_.front().bgr;
+    }
+
+private:
+    struct Entry {
+        int dictIdx, id, size, border;
+        uint64_t serial;
+        Mat bgr;
+    };
+    std::list<Entry> entries_; // most recently used first
+    size_t bytes_ = 0;
+    uint64_t nextSerial_ = 0;
+    const size_t maxBytes_;
+};
+
+static int infoPanelHeight(const State& s) {
+    const int lh = 20; // must match overlayInfo
+    int baseLines = 6; // title + dict + id + size + border + save
+    int extra = s.showHelp ? 4 : 0; // half-gap + 3 help lines ~ 4 lines
+    return 10 + (baseLines + extra) * lh + 10; // padding
+}
+
+// Everything overlayInfo prints depends on these
+static std::string infoKey(const State& s) {
+    return cv::format("%d|%d|%d|%d|%d|%d|", s.dictIdx, s.markerId, currentDictSize(s), s.markerSize, s.borderBits,
+                      (int)s.showHelp) + s.defaultOut;
+}
+
+// The window as two layers, marker on top and info panel below, composed
+// into one persistent canvas; each is redrawn only when its inputs change.
+class GeneratorView {
+public:
+    void show(const std::string& win, const State& s, const std::string& flash = std::string()) {
+        uint64_t serial = 0;
+        const Mat& marker = markers_.get(s, serial);
+        const int infoH = infoPanelHeight(s);
+        bool markerDirty = serial != shownMarker_;
+        if (canvas_.rows != marker.rows + infoH || canvas_.cols != marker.cols) {
+            canvas_.create(marker.rows + infoH, marker.cols, CV_8UC3);
+            markerDirty = true;
+            shownInfo_.clear();
+        }
+        if (markerDirty) {
+            marker.copyTo(canvas_(Rect(0, 0, marker.cols, marker.rows)));
+            shownMarker_ = serial;
+        }
+        const std::string key = infoKey(s);
+        Mat panel = canvas_(Rect(0, marker.rows, marker.cols, infoH));
+        if (key != shownInfo_ || !flash.empty()) {
+            panel.setTo(Scalar(255, 255, 255));
+            overlayInfo(panel, s, 0);
+            // A flash is on the panel until the next redraw of it
+            shownInfo_ = flash.empty() ? key : std::string();
+        }
+        if (!flash.empty()) {
+            putText(panel, flash, Point(10, panel.rows - 10), FONT_HERSHEY_SIMPLEX, 0.6, Scalar(0,0,0), 3, LINE_AA);
+            putText(panel, flash, Point(10, panel.rows - 10), FONT_HERSHEY_SIMPLEX, 0.6, Scalar(0,255,255), 2, LINE_AA);
+        }
+        imshow(win, canvas_);
+    }
+
+private:
+    MarkerLru markers_{256u << 20};
+    uint64_t shownMarker_ = 0; // serial of the bitmap on the canvas
+    std::string shownInfo_;
+    Mat canvas_;
+};
+// ---- End GUI layer helpers ----
+
+static bool hasExtension(const std::string& path, const char* ext) {
+    std::string lower = path;
+    for (char& c : lower) c = (char)tolower((unsigned char)c);
+    const size_t n = std::strlen(ext);
+    return lower.size() > n && lower.compare(lower.size() - n, n, ext) == 0;
+}
+
+// 's' key: .svg and .pdf paths get the vector marker, sized like the PNG at
+// 96 px per inch; anything else is the rendered bitmap
+static bool saveMarker(const State& s, const std::string& path) {
+    if (!hasExtension(path, ".svg") && !hasExtension(path, ".pdf")) return imwrite(path, renderMarker(s));
+    const Ptr<aruco::Dictionary>& dict = currentDictionary(s);
+    const int id = std::max(0, std::min(dict->bytesList.rows - 1, s.markerId));
+    const int bb = std::max(0, std::min(7, s.borderBits));
+    const int ms = std::max(50, s.markerSize);
+    const int margin = std::max(30, ms / 5); // as in renderMarker
+    const double mmPerPx = 25.4 / 96.0;
+    VectorPage page;
+    page.widthMm = page.heightMm = (ms + 2 * margin) * mmPerPx;
+    page.addMarker(markerCellRects(*dict, id, bb), dict->markerSize + 2 * bb, margin * mmPerPx, margin * mmPerPx,
+                   ms * mmPerPx);
+    return hasExtension(path, ".svg") ? writeSvg(path, page) : writePdf(path, std::vector<VectorPage>(1, page));
+}
+
+// ---- Batch sheet helpers ----
+struct SheetConfig {
+    std::string outDir;
+    int firstId = 0;
+    int lastId = -1;        // -1 = last id of the dictionary
+    int markerSize = 300;   // px at dpi
+    int borderBits = 1;
+    int dpi = 300;
+    double pageWmm = 210.0; // A4 portrait
+    double pageHmm = 297.0;
+    std::string format = "png"; // png (one bitmap per sheet), svg (one file per sheet) or pdf (one document)
+};
+
+static bool parsePageSize(std::string name, double& wMm, double& hMm) {
+    for (char& c : name) c = (char)toupper((unsigned char)c);
+    if (name == "A3") { wMm = 297.0; hMm = 420.0; return true; }
+    if (name == "A4") { wMm = 210.0; hMm = 297.0; return true; }
+    if (name == "A5") { wMm = 148.0; hMm = 210.0; return true; }
+    if (name == "LETTER") { wMm = 215.9; hMm = 279.4; return true; }
+    return false;
+}
+
+static bool writeSheet(const std::string& path, const Mat& sheet) {
+    try {
+        return imwrite(path, sheet);
+    } catch (const cv::Exception&) {
+        return false;
+    }
+}
+
+// Tile markers from..to onto pages with the same quiet zone renderMarker
+// uses, an ID label under each marker and cut marks on the cell corners.
+// Tiles of a page render in parallel; finished pages are encoded and written
+// in the background while the next one renders. Vector formats lay out the
+// same page in millimetres and skip rasterizing altogether.
+static int runBatch(const SheetConfig& sc, int dictIdx) {
+    const Ptr<aruco::Dictionary>& dict = DictCache::instance().get(dictIdx);
+    const std::string& dictName = kDicts[dictIdx].name;
+    const int dictSize = dict->bytesList.rows;
+    const int first = std::max(0, sc.firstId);
+    const int last = sc.lastId < 0 ? dictSize - 1 : std::min(dictSize - 1, sc.lastId);
+    if (first > last) {
+        std::cerr << "ID 范围 " << sc.firstId << ".." << sc.lastId << " 在 " << dictName << " (0.."
+                  << dictSize - 1 << ") 中为空." << std::endl;
+        return 2;
+    }
+
+    const int ms = std::max(50, sc.markerSize);
+    const int bb = std::max(0, std::min(7, sc.borderBits));
+    const int margin = std::max(30, ms / 5);
+    const int cell = ms + 2 * margin;
+    const int pageW = (int)std::lround(sc.pageWmm / 25.4 * sc.dpi);
+    const int pageH = (int)std::lround(sc.pageHmm / 25.4 * sc.dpi);
+    const int pagePad = (int)std::lround(5.0 / 25.4 * sc.dpi); // printers cannot reach the edge
+    const int cols = (pageW - 2 * pagePad) / cell;
+    const int rows = (pageH - 2 * pagePad) / cell;
+    if (cols < 1 || rows < 1) {
+        std::cerr << "标记尺寸 " << ms << " px 在 " << sc.dpi << " dpi 下超出页面." << std::endl;
+        return 2;
+    }
+    const int perSheet = cols * rows;
+    const int x0 = (pageW - cols * cell) / 2;
+    const int y0 = (pageH - rows * cell) / 2;
+    const int total = last - first + 1;
+    const int sheets = (total + perSheet - 1) / perSheet;
+
+    if (mkdir(sc.outDir.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "无法创建输出目录 " << sc.outDir << std::endl;
+        return 4;
+    }
+
+    const int arm = std::max(4, margin / 3);
+    const auto start = std::chrono::steady_clock::now();
+    auto report = [&](const std::string& where) {
+        const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Wrote " << total << " markers (" << dictName << " " << first << ".." << last << ") on "
+                  << sheets << " sheets of " << cols << "x" << rows << " to " << where
+                  << cv::format(" in %.2f s", sec) << std::endl;
+    };
+
+    if (sc.format != "png") {
+        const double mm = 25.4 / sc.dpi; // per sheet pixel
+        const int cellsPerSide = dict->markerSize + 2 * bb;
+        std::vector<VectorPage> pages;
+        int failed = 0;
+        for (int sheetNo = 0; sheetNo < sheets; ++sheetNo) {
+            const int base = first + sheetNo * perSheet;
+            const int count = std::min(perSheet, last + 1 - base);
+            VectorPage page;
+            page.widthMm = sc.pageWmm;
+            page.heightMm = sc.pageHmm;
+            for (int i = 0; i < count; ++i) {
+                const double cx = (x0 + (i % cols) * cell) * mm, cy = (y0 + (i / cols) * cell) * mm;
+                page.addMarker(markerCellRects(*dict, base + i, bb), cellsPerSide, cx + margin * mm, cy + margin * mm,
+                               ms * mm);
+                page.labels.push_back({cx + margin * mm, cy + (margin + ms + (margin * 2) / 3) * mm, 0.3 * margin * mm,
+                                       cv::format("%s  id %d", dictName.c_str(), base + i)});
+                for (int k = 0; k < 4; ++k) {
+                    const double px = cx + (k & 1) * cell * mm, py = cy + (k >> 1) * cell * mm;
+                    page.lines.push_back({px - arm * mm, py, px + arm * mm, py});
+                    page.lines.push_back({px, py - arm * mm, px, py + arm * mm});
+                }
+            }
+            if (sc.format == "svg") {
+                const std::string path = cv::format("%s/%s_%d-%d_sheet%03d.svg", sc.outDir.c_str(), dictName.c_str(),
+                                                    first, last, sheetNo);
+                if (!writeSvg(path, page)) ++failed;
+            } else {
+                pages.push_back(page);
+            }
+        }
+        std::string where = sc.outDir;
+        if (sc.format == "pdf") {
+            where = cv::format("%s/%s_%d-%d.pdf", sc.outDir.c_str(), dictName.c_str(), first, last);
+            if (!writePdf(where, pages)) failed = sheets;
+        }
+        if (failed) {
+            std::cerr << failed << " 张图纸写入 " << sc.outDir << " 失败." << std::endl;
+            return 4;
+        }
+        report(where);
+        return 0;
+    }
+
+    const double fontScale = std::max(0.3, margin / 90.0);
+    const size_t maxInFlight = std::max(2u, std::thread::hardware_concurrency());
+    std::deque<std::future<bool>> writes;
+    int failed = 0;
+
+    for (int sheetNo = 0; sheetNo < sheets; ++sheetNo) {
+        const int base = first + sheetNo * perSheet;
+        const int count = std::min(perSheet, last + 1 - base);
+        Mat sheet(pageH, pageW, CV_8UC1, Scalar(255));
+        parallel_for_(Range(0, count), [&](const Range& r) {
+            Mat marker;
+            for (int i = r.start; i < r.end; ++i) {
+                const Rect cellRect(x0 + (i % cols) * cell, y0 + (i / cols) * cell, cell, cell);
+                aruco::drawMarker(dict, base + i, ms, marker, bb);
+                marker.copyTo(sheet(Rect(cellRect.x + margin, cellRect.y + margin, ms, ms)));
+                // Drawn into the cell's own view, so parallel tiles never overlap
+                Mat cellView = sheet(cellRect);
+                putText(cellView, cv::format("%s  id %d", dictName.c_str(), base + i),
+                        Point(margin, margin + ms + (margin * 2) / 3), FONT_HERSHEY_SIMPLEX, fontScale,
+                        Scalar(96), 1, LINE_AA);
+            }
+        });
+        // Cut marks on every corner of every used cell; shared corners just repeat
+        for (int i = 0; i < count; ++i) {
+            const Point tl(x0 + (i % cols) * cell, y0 + (i / cols) * cell);
+            const Point corners[4] = {tl, tl + Point(cell, 0), tl + Point(0, cell), tl + Point(cell, cell)};
+            for (const Point& p : corners) {
+                line(sheet, Point(p.x - arm, p.y), Point(p.x + arm, p.y), Scalar(0), 1);
+                line(sheet, Point(p.x, p.y - arm), Point(p.x, p.y + arm), Scalar(0), 1);
+            }
+        }
+
+        const std::string path = cv::format("%s/%s_%d-%d_sheet%03d.png", sc.outDir.c_str(), dictName.c_str(),
+                                            first, last, sheetNo);
+        writes.push_back(std::async(std::launch::async, writeSheet, path, sheet));
+        while (writes.size() >= maxInFlight) {
+            if (!writes.front().get()) ++failed;
+            writes.pop_front();
+        }
+    }
+    for (auto& w : writes)
+        if (!w.get()) ++failed;
+
+    if (failed) {
+        std::cerr << failed << " 张图纸写入 " << sc.outDir << " 失败." << std::endl;
+        return 4;
+    }
+    report(sc.outDir);
+    return 0;
+}
+// ---- End batch sheet helpers ----
+
 int main(int argc, char** argv) {
     // Optional CLI to set initial state
     const char* keys =
-        "{o  |       | default output path for 's' key }"
+        "{o  |       | default output path for 's' key (.svg/.pdf = vector) }"
         "{d  | 8     | dictionary index (0..16, see source) }"
         "{id | 0     | initial marker id }"
         "{ms | 300   | marker size (px) }"  // smaller default
-        "{bb | 1     | border bits (0..7) }";
+        "{bb | 1     | border bits (0..7) }"
+        "{batch |    | write print sheets of markers to this directory instead of opening the GUI }"
+        "{from  | 0  | batch: first marker id }"
+        "{to    | -1 | batch: last marker id (-1 = last in the dictionary) }"
+        "{page  | A4 | batch: sheet size A3, A4, A5 or Letter }"
+        "{dpi   | 300 | batch: sheet resolution, ms is in pixels at this dpi }"
+        "{format | png | batch: png, svg (vector, one file per sheet) or pdf (vector, one document) }";
 
     CommandLineParser parser(argc, argv, keys);
     parser.about("Interactive ArUco marker generator with GUI");
 
     State s;
+    SheetConfig sheetCfg;
+    std::string page = "A4";
     if (parser.check()) {
         s.defaultOut = parser.get<String>("o");
         s.dictIdx    = parser.get<int>("d");
         s.markerId   = parser.get<int>("id");
         s.markerSize = parser.get<int>("ms");
         s.borderBits = parser.get<int>("bb");
+        sheetCfg.outDir  = parser.get<String>("batch");
+        sheetCfg.firstId = parser.get<int>("from");
+        sheetCfg.lastId  = parser.get<int>("to");
+        sheetCfg.dpi     = std::max(72, parser.get<int>("dpi"));
+        page = parser.get<String>("page");
+        sheetCfg.format = parser.get<String>("format");
     } else {
         parser.printErrors();
     }
 
+    // Headless: no window, no warm-up of dictionaries that are never used
+    if (!sheetCfg.outDir.empty()) {
+        if (!parsePageSize(page, sheetCfg.pageWmm, sheetCfg.pageHmm)) {
+            std::cerr << "未知的页面尺寸 " << page << " (可选: A3, A4, A5, Letter)." << std::endl;
+            return 2;
+        }
+        if (sheetCfg.format != "png" && sheetCfg.format != "svg" && sheetCfg.format != "pdf") {
+            std::cerr << "未知的输出格式 " << sheetCfg.format << " (可选: png, svg, pdf)." << std::endl;
+            return 2;
+        }
+        sheetCfg.markerSize = s.markerSize;
+        sheetCfg.borderBits = s.borderBits;
+        return runBatch(sheetCfg, std::max(0, std::min((int)kDicts.size() - 1, s.dictIdx)));
+    }
+
     srand((unsigned)time(nullptr));
+    DictCache::instance().warm(std::max(0, std::min((int)kDicts.size() - 1, s.dictIdx)));
 
     const std::string kWin = "ArUco Marker";
     namedWindow(kWin, WINDOW_AUTOSIZE);
 
     bool needRedraw = true;
+    GeneratorView view;
 
     for (;;) {
         if (needRedraw) {
-            Mat img = renderMarker(s);
-            Mat imgBgr;
-            if (img.channels() == 1) cvtColor(img, imgBgr, COLOR_GRAY2BGR); else imgBgr = img;
-
-            // Compute info panel height based on lines
-            const int lh = 20; // must match overlayInfo
-            int baseLines = 6; // title + dict + id + size + border + save
-            int extra = s.showHelp ? 4 : 0; // half-gap + 3 help lines ~ 4 lines
-            int infoHeight = 10 + (baseLines + extra) * lh + 10; // padding
-
-            Mat canvas(imgBgr.rows + infoHeight, imgBgr.cols, CV_8UC3, Scalar(255,255,255));
-            // place marker on top
-            imgBgr.copyTo(canvas(Rect(0, 0, imgBgr.cols, imgBgr.rows)));
-            // draw info below
-            overlayInfo(canvas, s, imgBgr.rows);
-            imshow(kWin, canvas);
+            view.show(kWin, s);
             needRedraw = false;
         }
 
@@ -220,22 +588,11 @@ int main(int argc, char** argv) {
 
         // Save PNG
     if (ch == 's' || ch == 'S') {
-            Mat img = renderMarker(s);
             std::string path = s.defaultOut.empty() ? autoFileName(s) : s.defaultOut;
             try {
-                imwrite(path, img);
-                // Briefly flash a message by redrawing overlay
-                Mat imgBgr; if (img.channels()==1) cvtColor(img, imgBgr, COLOR_GRAY2BGR); else imgBgr = img;
-                const int lh = 20; int baseLines = 6; int extra = s.showHelp ? 4 : 0;
-                int infoHeight = 10 + (baseLines + extra) * lh + 10;
-                Mat canvas(imgBgr.rows + infoHeight, imgBgr.cols, CV_8UC3, Scalar(255,255,255));
-                imgBgr.copyTo(canvas(Rect(0,0,imgBgr.cols,imgBgr.rows)));
-                overlayInfo(canvas, s, imgBgr.rows);
-                putText(canvas, "Saved: " + path, Point(10, canvas.rows - 10), FONT_HERSHEY_SIMPLEX,
-                        0.6, Scalar(0,0,0), 3, LINE_AA);
-                putText(canvas, "Saved: " + path, Point(10, canvas.rows - 10), FONT_HERSHEY_SIMPLEX,
-                        0.6, Scalar(0,255,255), 2, LINE_AA);
-                imshow(kWin, canvas);
+                saveMarker(s, path);
+                // Briefly flash a message on the info panel; the marker layer stays
+                view.show(kWin, s, "Saved: " + path);
             } catch (const std::exception&){ /* ignore */ }
             continue;
         }
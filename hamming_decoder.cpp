@@ -0,0 +1,169 @@
+#include "hamming_decoder.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DECODER_X86 1
+#endif
+
+// ---- Distance scan kernels ----
+// words holds 4 rotations per marker. A kernel returns the first marker whose
+// closest rotation is within maxDist bits of cand (rotation set to the first
+// closest one), or -1: the order Dictionary::identify uses. Dictionaries only
+// correct up to half their minimum codeword distance, so that marker is also
+// the nearest one.
+typedef int (*ScanFn)(const uint64_t* words, size_t markers, uint64_t cand, int maxDist, int& rotation);
+
+__attribute__((always_inline))
+static inline int scanMarkers(const uint64_t* words, size_t markers, uint64_t cand, int maxDist, int& rotation) {
+    for (size_t m = 0; m < markers; ++m) {
+        const uint64_t* w = words + 4 * m;
+        int best = 65, bestRot = 0;
+        for (int r = 0; r < 4; ++r) {
+            int d = __builtin_popcountll(w[r] ^ cand);
+            if (d < best) { best = d; bestRot = r; }
+        }
+        if (best <= maxDist) {
+            rotation = bestRot;
+            return (int)m;
+        }
+    }
+    return -1;
+}
+
+static int scanGeneric(const uint64_t* words, size_t markers, uint64_t cand, int maxDist, int& rotation) {
+    return scanMarkers(words, markers, cand, maxDist, rotation);
+}
+
+#ifdef DECODER_X86
+// Same loop, with __builtin_popcountll compiled to the popcnt instruction
+__attribute__((target("popcnt")))
+static int scanPopcnt(const uint64_t* words, size_t markers, uint64_t cand, int maxDist, int& rotation) {
+    return scanMarkers(words, markers, cand, maxDist, rotation);
+}
+
+// One marker (its 4 rotations) per iteration: nibble-LUT popcount, summed per
+// 64-bit lane with sad_epu8. Only markers with a lane in range leave SIMD.
+__attribute__((target("avx2,popcnt")))
+static int scanAvx2(const uint64_t* words, size_t markers, uint64_t cand, int maxDist, int& rotation) {
+    const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i lowNibble = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i c = _mm256_set1_epi64x((long long)cand);
+    const __m256i limit = _mm256_set1_epi64x(maxDist);
+    for (size_t m = 0; m < markers; ++m) {
+        const __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(words + 4 * m)), c);
+        const __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, _mm256_and_si256(x, lowNibble)),
+                                            _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), lowNibble)));
+        const __m256i dist = _mm256_sad_epu8(cnt, zero);
+        if (_mm256_movemask_epi8(_mm256_cmpgt_epi64(dist, limit)) == -1) continue;
+        alignas(32) uint64_t d[4];
+        _mm256_store_si256((__m256i*)d, dist);
+        int bestRot = 0;
+        for (int r = 1; r < 4; ++r)
+            if (d[r] < d[bestRot]) bestRot = r;
+        rotation = bestRot;
+        return (int)m;
+    }
+    return -1;
+}
+#endif
+
+struct ScanKernel {
+    ScanFn fn;
+    const char* name;
+};
+
+static ScanKernel pickScanKernel() {
+#ifdef DECODER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) return {scanAvx2, "avx2"};
+    if (__builtin_cpu_supports("popcnt")) return {scanPopcnt, "popcnt"};
+#endif
+    return {scanGeneric, "generic"}; // aarch64 lowers __builtin_popcountll to cnt
+}
+
+static const ScanKernel& scanKernel() {
+    static const ScanKernel k = pickScanKernel();
+    return k;
+}
+
+const char* HammingDecoder::popcountIsa() {
+    return scanKernel().name;
+}
+// ---- End distance scan kernels ----
+
+static inline uint64_t slotHash(uint64_t key) {
+    return (key * 0x9E3779B97F4A7C15ull) >> 32;
+}
+
+std::shared_ptr<const HammingDecoder> HammingDecoder::create(const cv::aruco::Dictionary& dict) {
+    const int n = dict.markerSize;
+    if (n <= 0 || n * n > 64) return nullptr;
+
+    std::shared_ptr<HammingDecoder> dec(new HammingDecoder());
+    dec->markerSize_ = n;
+    dec->maxCorrectionBits_ = dict.maxCorrectionBits;
+    const int markers = dict.bytesList.rows;
+    dec->words_.resize((size_t)markers * 4);
+    for (int m = 0; m < markers; ++m) {
+        const cv::Mat bits = cv::aruco::Dictionary::getBitsFromByteList(dict.bytesList.rowRange(m, m + 1), n);
+        // Rotation r laid out exactly as Dictionary::getByteListFromBits does
+        for (int r = 0; r < 4; ++r) {
+            uint64_t w = 0;
+            for (int row = 0; row < n; ++row)
+                for (int col = 0; col < n; ++col) {
+                    uchar b;
+                    switch (r) {
+                        case 0: b = bits.at<uchar>(row, col); break;
+                        case 1: b = bits.at<uchar>(col, n - 1 - row); break;
+                        case 2: b = bits.at<uchar>(n - 1 - row, n - 1 - col); break;
+                        default: b = bits.at<uchar>(n - 1 - col, row); break;
+                    }
+                    w = (w << 1) | (b ? 1u : 0u);
+                }
+            dec->words_[(size_t)m * 4 + r] = w;
+        }
+    }
+
+    // At most half full; a word shared by several markers or rotations keeps
+    // its first (lowest id, lowest rotation) entry, as the linear search would.
+    size_t capacity = 16;
+    while (capacity < dec->words_.size() * 2) capacity <<= 1;
+    dec->slotKeys_.assign(capacity, 0);
+    dec->slotValues_.assign(capacity, -1);
+    dec->slotMask_ = capacity - 1;
+    for (size_t i = 0; i < dec->words_.size(); ++i) {
+        const uint64_t key = dec->words_[i];
+        uint64_t s = slotHash(key) & dec->slotMask_;
+        while (dec->slotValues_[s] >= 0 && dec->slotKeys_[s] != key) s = (s + 1) & dec->slotMask_;
+        if (dec->slotValues_[s] >= 0) continue;
+        dec->slotKeys_[s] = key;
+        dec->slotValues_[s] = (int32_t)i;
+    }
+    return dec;
+}
+
+bool HammingDecoder::identify(const cv::Mat& onlyBits, int& id, int& rotation, double maxCorrectionRate) const {
+    if (onlyBits.rows != markerSize_ || onlyBits.cols != markerSize_) return false;
+    uint64_t cand = 0;
+    for (int row = 0; row < markerSize_; ++row) {
+        const uchar* p = onlyBits.ptr<uchar>(row);
+        for (int col = 0; col < markerSize_; ++col) cand = (cand << 1) | (p[col] ? 1u : 0u);
+    }
+
+    for (uint64_t s = slotHash(cand) & slotMask_; slotValues_[s] >= 0; s = (s + 1) & slotMask_) {
+        if (slotKeys_[s] == cand) {
+            id = slotValues_[s] / 4;
+            rotation = slotValues_[s] % 4;
+            return true;
+        }
+    }
+
+    const int maxDist = (int)((double)maxCorrectionBits_ * maxCorrectionRate);
+    if (maxDist <= 0) return false;
+    int m = scanKernel().fn(words_.data(), words_.size() / 4, cand, maxDist, rotation);
+    if (m < 0) return false;
+    id = m;
+    return true;
+}
@@ -0,0 +1,38 @@
+// Codeword lookup for aruco dictionaries with grids of up to 8x8 bits: every
+// rotation of every marker is packed into one 64-bit word, exact matches are
+// answered by a hash index and the rest by a popcount scan over the table.
+
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/aruco.hpp>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class HammingDecoder {
+public:
+    // Null when the dictionary's grid does not fit in 64 bits
+    static std::shared_ptr<const HammingDecoder> create(const cv::aruco::Dictionary& dict);
+
+    // Same contract as cv::aruco::Dictionary::identify: onlyBits is the
+    // markerSize x markerSize grid of 0/1 (CV_8UC1, may be a ROI view).
+    bool identify(const cv::Mat& onlyBits, int& id, int& rotation, double maxCorrectionRate) const;
+
+    int markerSize() const { return markerSize_; }
+
+    // Instruction set used by the distance scan: avx2, popcnt or generic
+    static const char* popcountIsa();
+
+private:
+    HammingDecoder() {}
+
+    int markerSize_ = 0;
+    int maxCorrectionBits_ = 0;
+    std::vector<uint64_t> words_; // [id * 4 + rotation]
+
+    // Open addressing, power-of-two capacity; value -1 marks an empty slot
+    std::vector<uint64_t> slotKeys_;
+    std::vector<int32_t> slotValues_; // index into words_
+    uint64_t slotMask_ = 0;
+};
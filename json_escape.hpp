@@ -0,0 +1,27 @@
+// String escaping shared by every JSON writer (bench report, replay lines,
+// trace export), so the same string comes out the same everywhere.
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+// Body of a JSON string literal: quotes and backslashes escaped, control
+// characters as \u00XX
+inline std::string jsonEscape(const std::string& in) {
+    std::string out;
+    out.reserve(in.size());
+    for (char c : in) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", (unsigned)(unsigned char)c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
@@ -0,0 +1,55 @@
+#include "latency_histogram.hpp"
+
+static const double kBoundsMs[LatencyHistogram::kBounds] = {
+    0.25, 0.5, 1, 2, 3, 5, 7.5, 10, 15, 20, 30, 50, 75, 100, 200, 500, 1000,
+};
+
+double LatencyHistogram::boundMs(int i) {
+    return kBoundsMs[i];
+}
+
+void LatencyHistogram::record(double ms) {
+    if (ms < 0) ms = 0; // clocks of different threads can disagree by a hair
+    int b = 0;
+    while (b < kBounds && ms > kBoundsMs[b]) ++b;
+    ++counts_[b];
+    ++count_;
+    sumMs_ += ms;
+}
+
+double LatencyHistogram::quantileMs(double q) const {
+    if (count_ == 0) return 0.0;
+    const double rank = q * (double)count_;
+    uint64_t below = 0;
+    for (int b = 0; b <= kBounds; ++b) {
+        if (counts_[b] == 0 || (double)(below + counts_[b]) < rank) {
+            below += counts_[b];
+            continue;
+        }
+        // The +Inf bucket has no width: report its lower bound
+        if (b == kBounds) return kBoundsMs[kBounds - 1];
+        const double lo = b == 0 ? 0.0 : kBoundsMs[b - 1];
+        return lo + (kBoundsMs[b] - lo) * (rank - (double)below) / (double)counts_[b];
+    }
+    return kBoundsMs[kBounds - 1];
+}
+
+LatencyHistogram LatencyHistogram::since(const LatencyHistogram& earlier) const {
+    LatencyHistogram d;
+    for (int b = 0; b <= kBounds; ++b) d.counts_[b] = counts_[b] - earlier.counts_[b];
+    d.count_ = count_ - earlier.count_;
+    d.sumMs_ = sumMs_ - earlier.sumMs_;
+    return d;
+}
+
+void LatencyHistogram::writePrometheus(std::ostream& os, const std::string& name, const std::string& labels) const {
+    const std::string sep = labels.empty() ? "" : ",";
+    uint64_t cumulative = 0;
+    for (int b = 0; b < kBounds; ++b) {
+        cumulative += counts_[b];
+        os << name << "_bucket{" << labels << sep << "le=\"" << kBoundsMs[b] / 1000.0 << "\"} " << cumulative << "\n";
+    }
+    os << name << "_bucket{" << labels << sep << "le=\"+Inf\"} " << count_ << "\n";
+    os << name << "_sum{" << labels << "} " << sumMs_ / 1000.0 << "\n";
+    os << name << "_count{" << labels << "} " << count_ << "\n";
+}
@@ -0,0 +1,44 @@
+// Fixed-bucket latency histograms for the pipeline stages, with quantile
+// estimates for log lines and Prometheus text exposition for scraping.
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+class LatencyHistogram {
+public:
+    static const int kBounds = 17; // finite upper bounds, plus +Inf
+
+    // Upper bound of bucket i in milliseconds
+    static double boundMs(int i);
+
+    void record(double ms);
+    uint64_t count() const { return count_; }
+    double sumMs() const { return sumMs_; }
+
+    // Estimate by linear interpolation inside the bucket, as Prometheus'
+    // histogram_quantile does; 0 when empty
+    double quantileMs(double q) const;
+
+    // Samples recorded after earlier was copied from this histogram
+    LatencyHistogram since(const LatencyHistogram& earlier) const;
+
+    // _bucket/_sum/_count series in seconds; name and labels (without braces)
+    // are the caller's, as is the # TYPE line
+    void writePrometheus(std::ostream& os, const std::string& name, const std::string& labels) const;
+
+private:
+    uint64_t counts_[kBounds + 1] = {}; // per bucket, not cumulative
+    uint64_t count_ = 0;
+    double sumMs_ = 0.0;
+};
+
+// Where a frame's time goes, per camera
+struct StageLatency {
+    LatencyHistogram sensorToCapture; // driver timestamp -> read returned (known timestamps only)
+    LatencyHistogram captureToDetect; // read returned -> detection done (queue wait included)
+    LatencyHistogram detectToOutput;  // detection done -> result published by the render stage
+    LatencyHistogram display;         // published -> imshow returned (shown frames only)
+};
@@ -1,12 +1,38 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/aruco.hpp>
+#include <opencv2/core/ocl.hpp>
+#include "v4l2_capture.hpp"
+#include "aruco_detector.hpp"
+#include "marker_frontend.hpp"
+#include "hamming_decoder.hpp"
+#include "marker_pose.hpp"
+#include "result_publisher.hpp"
+#include "latency_histogram.hpp"
+#include "synthetic_scene.hpp"
+#include "stage_trace.hpp"
+#include "json_escape.hpp"
 #include <iostream>
 #include <chrono>
-#include <unordered_map>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <cctype>
+#include <thread>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <sstream>
 #include <termios.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <signal.h> // signals for clean exit
+#include <poll.h>
+#include <errno.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
 
 using namespace std;
 using namespace cv;
@@ -40,6 +66,28 @@ struct FpsStats {
         return avgFps;
     }
 };
+
+// Keeps every sample so tail latencies survive (unlike the EMAs above)
+struct LatencySamples {
+    std::vector<double> ms;
+
+    void add(double v) { ms.push_back(v); }
+    double percentile(const std::vector<double>& sorted, double q) const {
+        if (sorted.empty()) return 0.0;
+        size_t i = (size_t)std::ceil(q * sorted.size());
+        return sorted[std::min(sorted.size(), std::max<size_t>(1, i)) - 1];
+    }
+    // {"p50":..,"p95":..,"p99":..,"max":..,"mean":..}
+    std::string json() const {
+        std::vector<double> sorted(ms);
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0.0;
+        for (double v : sorted) sum += v;
+        return cv::format("{\"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f, \"mean\": %.3f}",
+                          percentile(sorted, 0.50), percentile(sorted, 0.95), percentile(sorted, 0.99),
+                          sorted.empty() ? 0.0 : sorted.back(), sorted.empty() ? 0.0 : sum / sorted.size());
+    }
+};
 // ---- End timing helpers ----
 
 // ---- Terminal (Unix) non-blocking input helpers ----
@@ -64,12 +112,6 @@ void disableRawTerminal() {
     fcntl(STDIN_FILENO, F_SETFL, flags & ~O_NONBLOCK);
     term_raw_enabled = false;
 }
-bool stdinKeyPressed(int& ch) {
-    unsigned char c;
-    ssize_t n = read(STDIN_FILENO, &c, 1);
-    if (n == 1) { ch = c; return true; }
-    return false;
-}
 // ---- End terminal helpers ----
 
 // Ensure raw terminal is restored automatically
@@ -99,18 +141,521 @@ static inline bool isExitKey(int k) {
     }
 }
 
-volatile sig_atomic_t g_signal_exit = 0;
-void handleSignal(int) { g_signal_exit = 1; }
+// Set by InputWatcher on a terminal exit key or SIGINT/SIGTERM/SIGHUP
+static std::atomic<bool> g_exitRequested(false);
+// Set by InputWatcher on SIGUSR1: reload the ID registry
+static std::atomic<bool> g_reloadRequested(false);
+
+// Watches stdin and a signalfd from its own thread so the hot loops only test
+// an atomic flag instead of issuing a read() syscall per frame.
+class InputWatcher {
+public:
+    // Must run before any other thread exists: the signals are blocked here
+    // and every thread created afterwards inherits that mask.
+    bool start(bool watchStdin) {
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGINT);
+        sigaddset(&mask, SIGTERM);
+        sigaddset(&mask, SIGHUP);
+        sigaddset(&mask, SIGUSR1);
+        if (pthread_sigmask(SIG_BLOCK, &mask, nullptr) != 0) return false;
+        sigFd_ = signalfd(-1, &mask, SFD_CLOEXEC);
+        wakeFd_ = eventfd(0, EFD_CLOEXEC);
+        if (sigFd_ < 0 || wakeFd_ < 0) return false;
+        thread_ = std::thread(&InputWatcher::run, this, watchStdin);
+        return true;
+    }
+    void stop() {
+        if (thread_.joinable()) {
+            uint64_t one = 1;
+            ssize_t n = write(wakeFd_, &one, sizeof(one));
+            (void)n;
+            thread_.join();
+        }
+        if (sigFd_ >= 0) { close(sigFd_); sigFd_ = -1; }
+        if (wakeFd_ >= 0) { close(wakeFd_); wakeFd_ = -1; }
+    }
+    ~InputWatcher() { stop(); }
+
+private:
+    void run(bool watchStdin) {
+        struct pollfd fds[3] = {
+            {sigFd_, POLLIN, 0},
+            {wakeFd_, POLLIN, 0},
+            {STDIN_FILENO, POLLIN, 0},
+        };
+        nfds_t nfds = watchStdin ? 3 : 2;
+        for (;;) {
+            if (poll(fds, nfds, -1) < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            if (fds[1].revents) return; // stop()
+            if (fds[0].revents & POLLIN) {
+                struct signalfd_siginfo si;
+                if (read(sigFd_, &si, sizeof(si)) == (ssize_t)sizeof(si)) {
+                    if (si.ssi_signo == SIGUSR1) g_reloadRequested.store(true);
+                    else g_exitRequested.store(true);
+                }
+            }
+            if (nfds == 3 && fds[2].revents) {
+                unsigned char c;
+                ssize_t n = read(STDIN_FILENO, &c, 1);
+                if (n == 1 && isExitKey(c)) g_exitRequested.store(true);
+                // stdin closed or not readable (e.g. </dev/null): stop watching it
+                if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) nfds = 2;
+            }
+        }
+    }
+
+    int sigFd_ = -1;
+    int wakeFd_ = -1;
+    std::thread thread_;
+};
 
 // Centralized exit request check (window key, terminal key, or signal)
 static inline bool exitRequested(int windowKey) {
-    if (isExitKey(windowKey)) return true;
-    int ch;
-    if (stdinKeyPressed(ch) && isExitKey(ch)) return true;
-    if (g_signal_exit) return true;
+    return isExitKey(windowKey) || g_exitRequested.load(std::memory_order_relaxed);
+}
+
+// ---- Pipeline helpers ----
+// What a stage does when the next stage has no free slot.
+enum class DropPolicy {
+    DropOldest, // evict the oldest queued item (lowest latency, live cameras)
+    DropNewest, // discard the incoming item
+    Block       // wait for the consumer (never lose frames)
+};
+
+static bool parseDropPolicy(const std::string& s, DropPolicy& out) {
+    if (s == "oldest") { out = DropPolicy::DropOldest; return true; }
+    if (s == "newest") { out = DropPolicy::DropNewest; return true; }
+    if (s == "block")  { out = DropPolicy::Block;      return true; }
     return false;
 }
 
+static inline void idleBackoff() {
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+}
+
+// Bounded ring of preallocated slots linking two pipeline stages.
+// Items are exchanged with T::swap() instead of copied, so the cv::Mat buffers
+// circulate between stages and are never reallocated in steady state.
+// Per-slot sequence numbers (Vyukov scheme) keep it lock-free even when the
+// producer evicts the oldest slot or several pool workers share one end.
+template <typename T>
+class FrameRing {
+public:
+    explicit FrameRing(size_t capacity)
+        : cap_(std::max<size_t>(1, capacity)), slots_(new Slot[cap_]) {
+        for (size_t i = 0; i < cap_; ++i) slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    // Call before any thread touches the ring, e.g. to size the frame buffers.
+    template <typename Init>
+    void preallocate(Init init) {
+        for (size_t i = 0; i < cap_; ++i) init(slots_[i].value);
+    }
+
+    // On success item receives the slot's previous (recyclable) contents.
+    bool tryPush(T& item) {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& s = slots_[pos % cap_];
+            size_t seq = s.seq.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = (std::ptrdiff_t)seq - (std::ptrdiff_t)pos;
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    s.value.swap(item);
+                    s.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // On success out holds the item and the slot keeps out's old buffers.
+    bool tryPop(T& out) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& s = slots_[pos % cap_];
+            size_t seq = s.seq.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = (std::ptrdiff_t)seq - (std::ptrdiff_t)(pos + 1);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    s.value.swap(out);
+                    s.seq.store(pos + cap_, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Release the oldest slot without taking its contents; the next push into
+    // it gets them as recyclable buffers.
+    bool tryDiscard() {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& s = slots_[pos % cap_];
+            size_t seq = s.seq.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = (std::ptrdiff_t)seq - (std::ptrdiff_t)(pos + 1);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    s.seq.store(pos + cap_, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Push honoring the drop policy. Returns false if item was dropped or the
+    // pipeline stopped; either way item is left holding reusable buffers.
+    // DropOldest evicts at most one item per push and leaves it in its slot,
+    // so whichever push takes that slot receives its buffers back; if another
+    // producer wins the freed slot, item itself is dropped.
+    bool push(T& item, DropPolicy policy, const std::atomic<bool>& running) {
+        bool evicted = false;
+        for (;;) {
+            if (tryPush(item)) return true;
+            if (!running.load(std::memory_order_relaxed)) return false;
+            switch (policy) {
+                case DropPolicy::DropNewest:
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                case DropPolicy::DropOldest:
+                    if (evicted) {
+                        dropped_.fetch_add(1, std::memory_order_relaxed);
+                        return false;
+                    }
+                    if (tryDiscard()) {
+                        evicted = true;
+                        dropped_.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    break;
+                case DropPolicy::Block:
+                    idleBackoff();
+                    break;
+            }
+        }
+    }
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::atomic<size_t> seq;
+        T value;
+    };
+    static_assert(std::atomic<size_t>::is_always_lock_free, "FrameRing needs lock-free size_t atomics");
+    const size_t cap_;
+    std::unique_ptr<Slot[]> slots_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    std::atomic<uint64_t> dropped_{0};
+};
+
+// Single-slot link that only ever holds the newest item (--latest-frame):
+// the producer overwrites, consumers take whatever is freshest. Replacing an
+// item nobody took counts as a drop. The critical sections are a few buffer
+// swaps, so a mutex is simpler than a lock-free multi-consumer scheme here.
+template <typename T>
+class LatestSlot {
+public:
+    template <typename Init>
+    void preallocate(Init init) { init(value_); }
+
+    // item receives the replaced contents: reusable buffers, or the stale item
+    void push(T& item) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        value_.swap(item);
+        if (fresh_) dropped_.fetch_add(1, std::memory_order_relaxed);
+        fresh_ = true;
+    }
+
+    bool tryPop(T& out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!fresh_) return false;
+        value_.swap(out);
+        fresh_ = false;
+        return true;
+    }
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    std::mutex mutex_;
+    T value_;
+    bool fresh_ = false;
+    std::atomic<uint64_t> dropped_{0};
+};
+
+// Layout of FramePacket::frame as delivered by the capture backend
+enum class PixelFormat {
+    BGR,  // default OpenCV conversion (CAP_PROP_CONVERT_RGB on)
+    GRAY, // V4L2 GREY/Y800: the frame is the luma plane
+    YUYV, // packed 4:2:2, Y0 U Y1 V
+    UYVY, // packed 4:2:2, U Y0 V Y1
+    NV12  // planar 4:2:0: h rows of Y followed by h/2 rows of interleaved UV
+};
+
+// View raw as a rows x cols image of the given type. Uses raw's own header
+// (and stride) when it already has that shape; with CONVERT_RGB off some
+// backends hand back a flat 1xN byte buffer instead.
+static cv::Mat asImage(const cv::Mat& raw, int rows, int cols, int type) {
+    if (raw.type() == type && raw.cols == cols && raw.rows >= rows) return raw.rowRange(0, rows);
+    return cv::Mat(rows, cols, type, raw.data);
+}
+
+// Luma for detection. GRAY and NV12 expose the Y plane as a header over the
+// driver buffer (no copy); packed 4:2:2 needs one gather pass into buf.
+static cv::Mat lumaView(const cv::Mat& raw, PixelFormat fmt, const cv::Size& size, cv::Mat& buf) {
+    switch (fmt) {
+        case PixelFormat::BGR:
+            cv::cvtColor(raw, buf, cv::COLOR_BGR2GRAY);
+            return buf;
+        case PixelFormat::GRAY:
+        case PixelFormat::NV12:
+            return asImage(raw, size.height, size.width, CV_8UC1);
+        case PixelFormat::YUYV:
+            cv::cvtColor(asImage(raw, size.height, size.width, CV_8UC2), buf, cv::COLOR_YUV2GRAY_YUY2);
+            return buf;
+        case PixelFormat::UYVY:
+            cv::cvtColor(asImage(raw, size.height, size.width, CV_8UC2), buf, cv::COLOR_YUV2GRAY_UYVY);
+            return buf;
+    }
+    return buf;
+}
+
+// Color version of raw for display; only called for frames that are shown.
+static void toBgr(const cv::Mat& raw, PixelFormat fmt, const cv::Size& size, cv::Mat& bgr) {
+    switch (fmt) {
+        case PixelFormat::BGR:
+            bgr = raw;
+            break;
+        case PixelFormat::GRAY:
+            cv::cvtColor(asImage(raw, size.height, size.width, CV_8UC1), bgr, cv::COLOR_GRAY2BGR);
+            break;
+        case PixelFormat::YUYV:
+            cv::cvtColor(asImage(raw, size.height, size.width, CV_8UC2), bgr, cv::COLOR_YUV2BGR_YUY2);
+            break;
+        case PixelFormat::UYVY:
+            cv::cvtColor(asImage(raw, size.height, size.width, CV_8UC2), bgr, cv::COLOR_YUV2BGR_UYVY);
+            break;
+        case PixelFormat::NV12:
+            cv::cvtColor(asImage(raw, size.height * 3 / 2, size.width, CV_8UC1), bgr, cv::COLOR_YUV2BGR_NV12);
+            break;
+    }
+}
+
+// One frame travelling through capture -> detect -> render.
+// Detection results are the Detections base; the rest travels with the frame
+struct FramePacket : Detections {
+    cv::Mat frame;          // as captured, see format
+    PixelFormat format = PixelFormat::BGR;
+    cv::Size size;          // image size (frame may be a flat raw buffer)
+    V4l2BufferLease lease;  // set when frame is a view over a V4L2 driver buffer
+    uint64_t seq = 0;       // per camera
+    int camera = 0;         // index into the opened sources
+    double sensorMs = 0.0;  // driver timestamp, same clock as captureMs; 0 if unknown
+    double captureMs = 0.0; // when cap.read() returned
+    double detectMs = 0.0;  // time spent in detectMarkers
+    double detectDoneMs = 0.0;
+    std::vector<MarkerPose> poses; // filled by the pose stage (--calib), parallel to ids
+
+    void swap(FramePacket& o) {
+        Detections::swap(o);
+        cv::swap(frame, o.frame);
+        std::swap(format, o.format);
+        std::swap(size, o.size);
+        std::swap(lease, o.lease);
+        std::swap(seq, o.seq);
+        std::swap(camera, o.camera);
+        std::swap(sensorMs, o.sensorMs);
+        std::swap(captureMs, o.captureMs);
+        std::swap(detectMs, o.detectMs);
+        std::swap(detectDoneMs, o.detectDoneMs);
+        poses.swap(o.poses);
+    }
+};
+
+struct DisplayConfig {
+    bool gui = true;           // false: no imshow/waitKey at all (headless)
+    bool overlay = true;       // draw markers/labels onto displayed frames
+    bool antialias = true;     // false: LINE_8 and a simpler font (cheap mode)
+    bool showRejected = false; // also outline rejected candidates (costly)
+    double maxFps = 0.0;       // display rate cap per camera, 0 = every frame
+};
+
+// Give a leased V4L2 buffer back to the driver. The frame header pointed into
+// it, so it is dropped too rather than reused as a capture target.
+static inline void releaseLease(FramePacket& p) {
+    if (!p.lease.active()) return;
+    p.lease.release();
+    p.frame.release();
+}
+
+struct PoseConfig {
+    std::string calibPath;      // camera intrinsics; empty = no pose stage
+    double markerLength = 0.05; // marker side in metres (tvec uses the same unit)
+};
+
+struct LatencyReportConfig {
+    int logSec = 0;          // per-stage latency line every logSec seconds; 0 = off
+    std::string metricsPath; // Prometheus text file, rewritten every few seconds
+    std::string tracePath;   // Chrome trace of the stage scopes, written at exit; empty = off
+};
+
+struct PublishConfig {
+    std::string shmName;   // shared-memory ring, e.g. /aruco_results; empty = off
+    int shmSlots = 64;
+    std::string udpTarget; // ADDR:PORT, multicast or unicast; empty = off
+};
+
+struct PipelineConfig {
+    int workers = std::max(1, (int)std::thread::hardware_concurrency() - 2);
+    int queueDepth = 4;
+    DropPolicy drop = DropPolicy::DropOldest;
+    bool latestFrame = false; // capture -> detect through one newest-frame slot per camera
+};
+
+// --pyramid chose not to downscale: the frame is too small for the expected markers
+static void warnPyramidLevel0(const cv::Size& size) {
+    std::cerr << "--pyramid: " << size.width << "x" << size.height
+              << " 下无法缩小 (层级 0), 金字塔不生效; 可用 --marker-px 指定最小标记边长." << std::endl;
+}
+// ---- End pipeline helpers ----
+
+// ---- ID registry helpers ----
+// Published snapshot. Readers copy the pointer once per frame; a reload
+// builds a new registry off to the side and swaps it in, and the old one is
+// freed when its last reader lets go.
+static std::shared_ptr<const IdRegistry> g_idRegistry;
+
+static std::shared_ptr<const IdRegistry> currentIdRegistry() {
+    return std::atomic_load(&g_idRegistry);
+}
+
+static void publishIdRegistry(std::shared_ptr<const IdRegistry> reg) {
+    std::atomic_store(&g_idRegistry, std::move(reg));
+}
+
+// Load path (or the built-in list when empty) and publish it. On failure
+// the current registry stays in place.
+static bool reloadIdRegistry(const std::string& path, const std::vector<int>& activeDicts) {
+    if (path.empty()) {
+        publishIdRegistry(IdRegistry::builtin(activeDicts));
+        return true;
+    }
+    std::string error;
+    std::shared_ptr<const IdRegistry> reg = IdRegistry::load(path, activeDicts, error);
+    if (!reg) {
+        std::cerr << error << std::endl;
+        return false;
+    }
+    std::cout << "Loaded " << reg->allowedCount() << " allowed IDs from " << path << std::endl;
+    publishIdRegistry(std::move(reg));
+    return true;
+}
+// ---- End ID registry helpers ----
+
+// ---- Parameter auto-tuning helpers ----
+struct BudgetConfig {
+    double targetMs = 0.0; // per-frame detection budget, 0 = tuning off
+};
+
+// Steps detection cost up or down between the configured parameters (level 0)
+// and a cheap single-scale profile (kMaxLevel) to keep the average detection
+// time under the budget. Fed from the render loop, which sees every result.
+class ParamAutoTuner {
+public:
+    static const int kMaxLevel = 4;
+
+    ParamAutoTuner(const BudgetConfig& cfg, const cv::aruco::DetectorParameters& base, SharedDetectorParams& live)
+        : cfg_(cfg), base_(base), live_(live) {}
+
+    bool enabled() const { return cfg_.targetMs > 0; }
+    int level() const { return level_; }
+
+    void update(double detectMs, size_t rejected) {
+        if (!enabled()) return;
+        avgMs_ = avgMs_ == 0.0 ? detectMs : 0.9 * avgMs_ + 0.1 * detectMs;
+        avgRejected_ = 0.9 * avgRejected_ + 0.1 * (double)rejected;
+        ++sinceChange_;
+
+        // Load spike: fall back to the cheap profile at once
+        if (detectMs > 2.0 * cfg_.targetMs && level_ < kMaxLevel && sinceChange_ > kSettleFrames) {
+            apply(kMaxLevel);
+            return;
+        }
+        if (sinceChange_ < kEvalFrames) return;
+
+        if (avgMs_ > cfg_.targetMs && level_ < kMaxLevel) {
+            // Many rejected candidates mean contour filtering dominates: skip ahead
+            apply(std::min(kMaxLevel, level_ + (avgRejected_ > kManyRejected ? 2 : 1)));
+        } else if (avgMs_ < 0.6 * cfg_.targetMs && level_ > 0) {
+            apply(level_ - 1);
+        } else {
+            sinceChange_ = kSettleFrames; // re-evaluate after another window
+        }
+    }
+
+private:
+    static const int kEvalFrames = 30;    // results between regular decisions
+    static const int kSettleFrames = 10;  // results ignored after a change
+    static const int kManyRejected = 50;
+
+    // Level L: minMarkerPerimeterRate grows linearly, threshold scales drop
+    // one every two levels down to a single window at the middle size.
+    cv::Ptr<cv::aruco::DetectorParameters> makeLevel(int level) const {
+        cv::Ptr<cv::aruco::DetectorParameters> p = cv::aruco::DetectorParameters::create();
+        *p = base_;
+        int lo = base_.adaptiveThreshWinSizeMin, hi = base_.adaptiveThreshWinSizeMax;
+        int baseScales = std::max(1, (hi - lo) / std::max(1, base_.adaptiveThreshWinSizeStep) + 1);
+        int scales = std::max(1, baseScales - level / 2);
+        if (level == kMaxLevel) scales = 1;
+        if (scales == 1) {
+            int mid = (lo + hi) / 2 | 1; // window sizes must be odd
+            p->adaptiveThreshWinSizeMin = p->adaptiveThreshWinSizeMax = mid;
+        } else {
+            p->adaptiveThreshWinSizeStep = std::max(1, (hi - lo) / (scales - 1));
+        }
+        p->minMarkerPerimeterRate = std::min(0.1, base_.minMarkerPerimeterRate * (1 + level));
+        return p;
+    }
+
+    void apply(int level) {
+        level_ = level;
+        sinceChange_ = 0;
+        cv::Ptr<cv::aruco::DetectorParameters> p = makeLevel(level);
+        live_.set(p);
+        int scales = (p->adaptiveThreshWinSizeMax - p->adaptiveThreshWinSizeMin) / p->adaptiveThreshWinSizeStep + 1;
+        std::cout << cv::format("auto-tune: level %d (%d threshold scales, minPerimeterRate %.3f), "
+                                "detect avg %.2f ms / budget %.2f ms\n",
+                                level, scales, p->minMarkerPerimeterRate, avgMs_, cfg_.targetMs);
+    }
+
+    BudgetConfig cfg_;
+    cv::aruco::DetectorParameters base_;
+    SharedDetectorParams& live_;
+    int level_ = 0;
+    int sinceChange_ = 0;
+    double avgMs_ = 0.0;
+    double avgRejected_ = 0.0;
+};
+// ---- End parameter auto-tuning helpers ----
+
 // Small helpers to open sources
 static bool tryOpenCamera(int index, cv::VideoCapture& cap, int w, int h) {
     cap.release();
@@ -120,9 +665,25 @@ static bool tryOpenCamera(int index, cv::VideoCapture& cap, int w, int h) {
     return cap.isOpened();
 }
 
-static void listCameras(int maxIndexToProbe = 10) {
+// Device path variant, e.g. /dev/video4 or a /dev/v4l/by-id/ symlink
+static bool tryOpenCamera(const std::string& path, cv::VideoCapture& cap, int w, int h) {
+    cap.release();
+    if (!cap.open(path, cv::CAP_V4L2)) return false;
+    cap.set(cv::CAP_PROP_FRAME_WIDTH, w);
+    cap.set(cv::CAP_PROP_FRAME_HEIGHT, h);
+    return cap.isOpened();
+}
+
+static bool isNumeric(const std::string& s) {
+    return !s.empty() && std::all_of(s.begin(), s.end(), [](unsigned char c){ return std::isdigit(c); });
+}
+
+static void listCameras(int maxIndexToProbe = 16) {
     std::cout << "Probing V4L2 cameras...\n";
     for (int i = 0; i < maxIndexToProbe; ++i) {
+        // Skip absent nodes without paying for a failed open()
+        struct stat st;
+        if (stat(cv::format("/dev/video%d", i).c_str(), &st) != 0) continue;
         cv::VideoCapture test;
         if (test.open(i)) {
             double w = test.get(cv::CAP_PROP_FRAME_WIDTH);
@@ -135,185 +696,1357 @@ static void listCameras(int maxIndexToProbe = 10) {
     }
 }
 
+// ---- Overlay helpers ----
+// Fixed-capacity marker list: reset() rewinds, storage is never freed
+struct MarkerSet {
+    static const int kMaxMarkers = 256;
+    struct Quad { cv::Point2f pts[4]; };
+
+    int count = 0;
+    int ids[kMaxMarkers];
+    int dicts[kMaxMarkers];
+    Quad quads[kMaxMarkers];
+
+    bool push(int dict, int id, const std::vector<cv::Point2f>& pts) {
+        if (count >= kMaxMarkers || pts.size() != 4) return false;
+        ids[count] = id;
+        dicts[count] = dict;
+        std::copy(pts.begin(), pts.end(), quads[count].pts);
+        ++count;
+        return true;
+    }
+};
+
+// Reusable per-frame overlay state owned by the render loop
+struct FrameContext {
+    MarkerSet correct; // allowed IDs
+    MarkerSet wrong;   // decoded but not allowed
+    std::shared_ptr<const IdRegistry> registry; // snapshot for the frame being drawn
+    const CameraIntrinsics* intrinsics = nullptr; // set with the pose stage, for axes
+    float axisLength = 0.0f;
+
+    void reset() { correct.count = 0; wrong.count = 0; }
+};
+
+// Same look as aruco::drawDetectedMarkers (sides, first-corner box, "id=N")
+// plus the thick border, drawn from fixed arrays without temporaries.
+static void drawMarkerQuad(cv::Mat& frame, const cv::Point2f* pts, const cv::Scalar& color,
+                           int thickness, int lineType, const std::string* idText) {
+    cv::Point poly[4];
+    for (int j = 0; j < 4; ++j) poly[j] = pts[j];
+    const cv::Point* ptsArr = poly;
+    int npts = 4;
+    cv::polylines(frame, &ptsArr, &npts, 1, true, color, thickness, thickness > 1 ? lineType : cv::LINE_8);
+    const cv::Scalar cornerColor(color[0], color[2], color[1]); // swap G and B
+    cv::rectangle(frame, pts[0] - cv::Point2f(3, 3), pts[0] + cv::Point2f(3, 3), cornerColor, 1, lineType);
+    if (idText) {
+        cv::Point2f c = (pts[0] + pts[1] + pts[2] + pts[3]) * 0.25f;
+        const cv::Scalar textColor(color[1], color[0], color[2]); // swap G and R
+        cv::putText(frame, *idText, c, cv::FONT_HERSHEY_SIMPLEX, 0.5, textColor, 2);
+    }
+}
+
+static void drawMarkerSet(cv::Mat& frame, const MarkerSet& set, const IdRegistry& registry,
+                          const cv::Scalar& color, const DisplayConfig& dcfg) {
+    const int lineType = dcfg.antialias ? cv::LINE_AA : cv::LINE_8;
+    const int font = dcfg.antialias ? cv::FONT_HERSHEY_DUPLEX : cv::FONT_HERSHEY_SIMPLEX;
+    for (int i = 0; i < set.count; ++i) {
+        const cv::Point2f* pts = set.quads[i].pts;
+        drawMarkerQuad(frame, pts, color, 6, lineType, &registry.idText(set.dicts[i], set.ids[i]));
+        cv::Point2f c = (pts[0] + pts[1] + pts[2] + pts[3]) * 0.25f;
+        cv::putText(frame, registry.label(set.dicts[i], set.ids[i]), c + cv::Point2f(-20, -10),
+                    font, 0.5, color, 1, lineType);
+    }
+}
+
+// Classify detections against the allow-list and draw them onto frame
+// (pkt.frame itself, or its color conversion). Returns the number of allowed markers.
+static int renderOverlay(cv::Mat& frame, const FramePacket& pkt, FrameContext& fc, const DisplayConfig& dcfg) {
+    fc.reset();
+    const IdRegistry& registry = *fc.registry;
+    for (size_t k = 0; k < pkt.ids.size(); ++k) {
+        int id = pkt.ids[k], dict = pkt.dicts[k];
+        (registry.allowed(dict, id) ? fc.correct : fc.wrong).push(dict, id, pkt.corners[k]);
+    }
+
+    if (!dcfg.overlay) return fc.correct.count;
+
+    drawMarkerSet(frame, fc.correct, registry, cv::Scalar(153, 0, 255), dcfg);
+    drawMarkerSet(frame, fc.wrong, registry, cv::Scalar(0, 0, 255), dcfg);
+
+    // Pose axes for allowed markers only, like the labels
+    if (fc.intrinsics) {
+        for (const MarkerPose& mp : pkt.poses)
+            if (registry.allowed(mp.dict, mp.id))
+                cv::drawFrameAxes(frame, fc.intrinsics->cameraMatrix, fc.intrinsics->distCoeffs,
+                                  mp.rvec, mp.tvec, fc.axisLength, 2);
+    }
+
+    // Draw rejected candidate quadrilaterals (failed final ID / criteria).
+    // Off by default: there are usually far more of them than markers.
+    if (dcfg.showRejected) {
+        for (const auto& quad : pkt.rejected)
+            if (quad.size() == 4) drawMarkerQuad(frame, quad.data(), cv::Scalar(60, 60, 255), 1, cv::LINE_8, nullptr);
+    }
+
+    return fc.correct.count;
+}
+// ---- End overlay helpers ----
+
+// ---- Benchmark helpers ----
+// Recorded input: a video file or a directory of images (read in name order)
+class FileFrameSource {
+public:
+    bool open(const std::string& path) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) return false;
+        if (!S_ISDIR(st.st_mode)) return cap_.open(path);
+        std::vector<cv::String> all;
+        cv::glob(path + "/*", all, false);
+        static const char* kExts[] = {".png", ".jpg", ".jpeg", ".bmp", ".tif", ".tiff", ".pgm", ".ppm"};
+        for (const auto& f : all) {
+            std::string lower = f;
+            std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+            for (const char* ext : kExts) {
+                size_t n = std::strlen(ext);
+                if (lower.size() > n && lower.compare(lower.size() - n, n, ext) == 0) { files_.push_back(f); break; }
+            }
+        }
+        std::sort(files_.begin(), files_.end());
+        return !files_.empty();
+    }
+    bool read(cv::Mat& frame) {
+        if (cap_.isOpened()) return cap_.read(frame) && !frame.empty();
+        while (next_ < files_.size()) {
+            frame = cv::imread(files_[next_++], cv::IMREAD_COLOR);
+            if (!frame.empty()) return true;
+        }
+        return false;
+    }
+
+    // Image directories can also be read out of order, one file per call
+    bool isDirectory() const { return !cap_.isOpened(); }
+    size_t imageCount() const { return files_.size(); }
+    const std::string& imagePath(size_t i) const { return files_[i]; }
+
+private:
+    cv::VideoCapture cap_;
+    std::vector<cv::String> files_;
+    size_t next_ = 0;
+};
+
+// Pre-rendered synthetic frames, copied out the way a capture would fill
+// its buffer, so the overlay never draws into the ring
+class SyntheticFrameSource {
+public:
+    SyntheticFrameSource(SyntheticScene& scene, int ringFrames, uint64_t frames)
+        : ring_(scene, ringFrames), left_(frames) {}
+    bool read(cv::Mat& frame) {
+        if (left_ == 0) return false;
+        --left_;
+        ring_.next(truth_).copyTo(frame);
+        return true;
+    }
+    const std::vector<SceneMarker>* truth() const { return truth_; }
+
+private:
+    SyntheticFrameRing ring_;
+    uint64_t left_;
+    const std::vector<SceneMarker>* truth_ = nullptr;
+};
+
+struct BenchConfig {
+    std::string input;           // video file or image directory
+    std::string jsonPath;        // empty = stdout
+    std::vector<int> synthetic;  // markers per frame, one run each (replaces input)
+    int syntheticFrames = 300;   // frames per synthetic run
+    cv::Size syntheticSize;      // from --size
+};
+
+// Truth-less sources report no recall
+static const std::vector<SceneMarker>* benchTruth(const FileFrameSource&) { return nullptr; }
+static const std::vector<SceneMarker>* benchTruth(const SyntheticFrameSource& src) { return src.truth(); }
+
+// One timed pass over src, returned as a JSON object. The tracker and pose
+// filter are per pass: both expect one frame sequence from the start.
+template <typename Source>
+static std::string benchmarkPass(Source& src, const std::string& inputName, DetectionContext ctx,
+                                 const TrackerConfig& tcfg, const PyramidConfig& pyrCfg, const DisplayConfig& dcfg,
+                                 const PoseConfig& poseCfg, FrameContext& fc, uint64_t& framesOut) {
+    RoiTracker tracker(tcfg);
+    ctx.cameras.resize(1);
+    ctx.cameras[0].tracker = &tracker;
+    std::unique_ptr<PoseEstimator> pose;
+    if (fc.intrinsics) pose.reset(new PoseEstimator(*fc.intrinsics, poseCfg.markerLength));
+
+    // detectMarkers does thresholding, contours and decoding in one call, so
+    // those three are reported together as "detect"; the in-tree front end
+    // also reports them separately.
+    LatencySamples capture, convert, detect, draw, total;
+    LatencySamples threshold, contours, decode, poseStage;
+    FramePacket pkt;
+    fc.registry = currentIdRegistry();
+    DetectScratch scratch;
+    FrontEndTimings& fet = scratch.frontEnd.timings();
+    cv::Mat gray;
+    uint64_t frames = 0, markers = 0, truthMarkers = 0, recalled = 0;
+    bool haveTruth = false;
+    double wallStart = nowMs();
+
+    while (!g_exitRequested.load(std::memory_order_relaxed)) {
+        double t0 = nowMs();
+        if (!src.read(pkt.frame)) break;
+        double t1 = nowMs();
+        if (pkt.frame.channels() == 3) cv::cvtColor(pkt.frame, gray, cv::COLOR_BGR2GRAY);
+        else gray = pkt.frame;
+        double t2 = nowMs();
+        if (frames == 0 && pyrCfg.enabled) {
+            ctx.cameras[0].pyramidLevel = choosePyramidLevel(gray.size(), *ctx.params, pyrCfg.expectedMarkerPx);
+            if (ctx.cameras[0].pyramidLevel == 0) warnPyramidLevel0(gray.size());
+        }
+        pkt.seq = frames;
+        fet.reset();
+        detectFrame(ctx, gray, 0, pkt.seq, *fc.registry, scratch, pkt);
+        double t3 = nowMs();
+        if (pose) {
+            pose->estimate(pkt.seq, pkt.dicts, pkt.ids, pkt.corners, pkt.poses);
+            double tp = nowMs();
+            poseStage.add(tp - t3);
+            t3 = tp;
+        }
+        renderOverlay(pkt.frame, pkt, fc, dcfg);
+        double t4 = nowMs();
+
+        capture.add(t1 - t0);
+        convert.add(t2 - t1);
+        detect.add(t3 - t2);
+        draw.add(t4 - t3);
+        total.add(t4 - t0);
+        if (ctx.fastFrontEnd) {
+            threshold.add(fet.thresholdMs);
+            contours.add(fet.contoursMs);
+            decode.add(fet.decodeMs);
+        }
+        if (const std::vector<SceneMarker>* truth = benchTruth(src)) {
+            haveTruth = true;
+            truthMarkers += truth->size();
+            recalled += countRecalled(*truth, pkt.dicts, pkt.ids, pkt.corners);
+        }
+        markers += pkt.ids.size();
+        ++frames;
+    }
+    double wallMs = nowMs() - wallStart;
+    framesOut = frames;
+
+    const cv::aruco::DetectorParameters& p = *ctx.params;
+    std::string dictList;
+    for (const DecodeDictionary& d : ctx.dicts)
+        dictList += std::string(dictList.empty() ? "" : ", ") + "\"" + findDictName(d.tag)->name + "\"";
+    std::ostringstream js;
+    js << "{\n"
+       << "  \"input\": \"" << jsonEscape(inputName) << "\",\n"
+       << "  \"opencv\": \"" << CV_VERSION << "\",\n"
+       << "  \"frontend\": \"" << (ctx.fastFrontEnd ? std::string("in-tree/") + (ctx.openCL ? "opencl" : thresholdIsa()) + "+" + HammingDecoder::popcountIsa()
+                                           : std::string("aruco")) << "\",\n"
+       << "  \"dictionaries\": [" << dictList << "],\n"
+       << "  \"params\": " << cv::format("{\"adaptiveThreshWinSizeMin\": %d, \"adaptiveThreshWinSizeMax\": %d, "
+                                         "\"adaptiveThreshWinSizeStep\": %d, \"minMarkerPerimeterRate\": %g, "
+                                         "\"maxMarkerPerimeterRate\": %g, \"polygonalApproxAccuracyRate\": %g, "
+                                         "\"pyramidLevel\": %d}",
+                                         p.adaptiveThreshWinSizeMin, p.adaptiveThreshWinSizeMax,
+                                         p.adaptiveThreshWinSizeStep, p.minMarkerPerimeterRate,
+                                         p.maxMarkerPerimeterRate, p.polygonalApproxAccuracyRate,
+                                         ctx.cameras[0].pyramidLevel) << ",\n"
+       << "  \"frames\": " << frames << ",\n"
+       << "  \"markers\": " << markers << ",\n";
+    if (haveTruth)
+        js << "  \"ground_truth\": " << cv::format("{\"markers\": %llu, \"recalled\": %llu, \"recall\": %.4f}",
+                                                   (unsigned long long)truthMarkers, (unsigned long long)recalled,
+                                                   truthMarkers ? (double)recalled / truthMarkers : 1.0) << ",\n";
+    js << "  \"wall_ms\": " << cv::format("%.3f", wallMs) << ",\n"
+       << "  \"fps\": " << cv::format("%.2f", wallMs > 0 ? frames * 1000.0 / wallMs : 0.0) << ",\n"
+       << "  \"stages_ms\": {\n"
+       << "    \"capture\": " << capture.json() << ",\n"
+       << "    \"convert\": " << convert.json() << ",\n"
+       << "    \"detect\": " << detect.json() << ",\n";
+    if (ctx.fastFrontEnd)
+        js << "    \"threshold\": " << threshold.json() << ",\n"
+           << "    \"contours\": " << contours.json() << ",\n"
+           << "    \"decode\": " << decode.json() << ",\n";
+    if (pose) js << "    \"pose\": " << poseStage.json() << ",\n";
+    js << "    \"draw\": " << draw.json() << ",\n"
+       << "    \"total\": " << total.json() << "\n"
+       << "  }\n"
+       << "}";
+    return js.str();
+}
+
+// Headless run over recorded or synthetic input: times each stage of every
+// frame and writes percentiles plus throughput as JSON at exit. A synthetic
+// sweep writes an array with one object per marker count.
+static int runBenchmark(const BenchConfig& bcfg, const DetectionContext& ctx, const TrackerConfig& tcfg,
+                        const PyramidConfig& pyrCfg, const DisplayConfig& dcfg, const PoseConfig& poseCfg,
+                        FrameContext& fc) {
+    std::string report;
+    uint64_t frames = 0;
+    if (bcfg.synthetic.empty()) {
+        FileFrameSource src;
+        if (!src.open(bcfg.input)) {
+            std::cerr << "无法打开基准测试输入 " << bcfg.input << " (需要视频文件或图片目录)." << std::endl;
+            return 3;
+        }
+        report = benchmarkPass(src, bcfg.input, ctx, tcfg, pyrCfg, dcfg, poseCfg, fc, frames) + "\n";
+    } else {
+        // Frames are rendered up front and reused, so the timed loop does no
+        // drawing and no disk I/O
+        const int kRingFrames = 32;
+        report = "[\n";
+        for (size_t i = 0; i < bcfg.synthetic.size() && !g_exitRequested.load(std::memory_order_relaxed); ++i) {
+            SceneConfig scfg;
+            scfg.size = bcfg.syntheticSize;
+            scfg.markers = bcfg.synthetic[i];
+            SyntheticScene scene(scfg, ctx.dicts[0].dict, ctx.dicts[0].tag);
+            SyntheticFrameSource src(scene, std::min(kRingFrames, bcfg.syntheticFrames), bcfg.syntheticFrames);
+            const std::string name = cv::format("synthetic:%d@%dx%d", scfg.markers, scfg.size.width, scfg.size.height);
+            uint64_t passFrames = 0;
+            report += (i ? ",\n" : "") + benchmarkPass(src, name, ctx, tcfg, pyrCfg, dcfg, poseCfg, fc, passFrames);
+            frames += passFrames;
+        }
+        report += "\n]\n";
+    }
+
+    if (bcfg.jsonPath.empty()) {
+        std::cout << report;
+    } else {
+        std::ofstream out(bcfg.jsonPath.c_str());
+        if (!out) {
+            std::cerr << "无法写入 " << bcfg.jsonPath << std::endl;
+            return 4;
+        }
+        out << report;
+    }
+    return frames > 0 ? 0 : 5;
+}
+// ---- End benchmark helpers ----
+
+// ---- Replay helpers ----
+struct ReplayConfig {
+    std::string input;   // video file or image directory
+    std::string outPath; // JSON Lines, one line per frame; empty = stdout
+    int workers = 0;     // 0 = every core
+};
+
+// Detections of one frame waiting for its turn in the output
+struct ReplayResult {
+    std::vector<int> ids;
+    std::vector<int> dicts;
+    std::vector<std::vector<cv::Point2f>> corners;
+};
+
+static void writeReplayLine(std::ostream& out, uint64_t frame, const std::string& file, const ReplayResult& r,
+                            const IdRegistry& registry, const std::vector<MarkerPose>* poses) {
+    std::string line = cv::format("{\"frame\": %llu", (unsigned long long)frame);
+    if (!file.empty()) line += ", \"file\": \"" + jsonEscape(file) + "\"";
+    line += ", \"markers\": [";
+    for (size_t i = 0; i < r.ids.size(); ++i) {
+        const std::vector<cv::Point2f>& c = r.corners[i];
+        line += cv::format("%s{\"dict\": \"%s\", \"id\": %d, \"allowed\": %s, "
+                           "\"corners\": [[%.2f, %.2f], [%.2f, %.2f], [%.2f, %.2f], [%.2f, %.2f]]",
+                           i ? ", " : "", findDictName(r.dicts[i])->name, r.ids[i],
+                           registry.allowed(r.dicts[i], r.ids[i]) ? "true" : "false",
+                           c[0].x, c[0].y, c[1].x, c[1].y, c[2].x, c[2].y, c[3].x, c[3].y);
+        if (poses) {
+            const MarkerPose& mp = (*poses)[i];
+            line += cv::format(", \"rvec\": [%.6f, %.6f, %.6f], \"tvec\": [%.6f, %.6f, %.6f]",
+                               mp.rvec[0], mp.rvec[1], mp.rvec[2], mp.tvec[0], mp.tvec[1], mp.tvec[2]);
+        }
+        line += "}";
+    }
+    line += "]}\n";
+    out << line;
+}
+
+// Re-run recorded footage through the detector: frames are independent, so
+// they are detected in parallel and written back in their original order.
+// Videos decode on one thread ahead of the pool; image directories are
+// decoded by the workers themselves. The ROI tracker stays off (it needs
+// frames in order); the pose stage runs in order on the output side.
+static int runReplay(const ReplayConfig& rcfg, DetectionContext ctx, const PyramidConfig& pyrCfg,
+                     PoseEstimator* pose) {
+    FileFrameSource src;
+    if (!src.open(rcfg.input)) {
+        std::cerr << "无法打开回放输入 " << rcfg.input << " (需要视频文件或图片目录)." << std::endl;
+        return 3;
+    }
+    std::ofstream outFile;
+    if (!rcfg.outPath.empty()) {
+        outFile.open(rcfg.outPath.c_str());
+        if (!outFile) {
+            std::cerr << "无法写入 " << rcfg.outPath << std::endl;
+            return 4;
+        }
+    }
+    std::ostream& out = rcfg.outPath.empty() ? std::cout : outFile;
+
+    const int workers = rcfg.workers > 0 ? rcfg.workers : std::max(1, (int)std::thread::hardware_concurrency());
+    if (workers > 1) cv::setNumThreads(1);
+    ctx.cameras.assign(1, CameraDetectState());
+    if (pyrCfg.enabled) {
+        // Frame size from a separate probe, before any worker reads the level
+        FileFrameSource probe;
+        cv::Mat first;
+        if (probe.open(rcfg.input) && probe.read(first)) {
+            ctx.cameras[0].pyramidLevel = choosePyramidLevel(first.size(), *ctx.params, pyrCfg.expectedMarkerPx);
+            if (ctx.cameras[0].pyramidLevel == 0) warnPyramidLevel0(first.size());
+        }
+    }
+
+    const bool directory = src.isDirectory();
+    FrameRing<FramePacket> decodeRing(2 * (size_t)workers);
+    FrameRing<FramePacket> resultRing(2 * (size_t)workers);
+    std::atomic<bool> running(true);
+    std::atomic<bool> decoding(!directory);
+    std::atomic<uint64_t> nextImage(0);
+    std::atomic<int> activeWorkers(workers);
+
+    std::thread decoder;
+    if (!directory) {
+        decoder = std::thread([&]() {
+            FramePacket pkt;
+            uint64_t seq = 0;
+            while (!g_exitRequested.load(std::memory_order_relaxed) && src.read(pkt.frame)) {
+                pkt.seq = seq++;
+                decodeRing.push(pkt, DropPolicy::Block, running);
+            }
+            decoding.store(false);
+        });
+    }
+
+    std::vector<std::thread> pool;
+    for (int w = 0; w < workers; ++w) {
+        pool.emplace_back([&]() {
+            FramePacket pkt;
+            DetectScratch scratch;
+            cv::Mat gray;
+            while (!g_exitRequested.load(std::memory_order_relaxed)) {
+                if (directory) {
+                    const uint64_t i = nextImage.fetch_add(1);
+                    if (i >= src.imageCount()) break;
+                    pkt.frame = cv::imread(src.imagePath((size_t)i), cv::IMREAD_COLOR);
+                    pkt.seq = i;
+                    // Unreadable files still get their (empty) line
+                    if (pkt.frame.empty()) {
+                        pkt.ids.clear(); pkt.dicts.clear(); pkt.corners.clear();
+                        resultRing.push(pkt, DropPolicy::Block, running);
+                        continue;
+                    }
+                } else {
+                    bool done = !decoding.load();
+                    if (!decodeRing.tryPop(pkt)) {
+                        if (done) break;
+                        idleBackoff();
+                        continue;
+                    }
+                }
+                if (pkt.frame.channels() == 3) cv::cvtColor(pkt.frame, gray, cv::COLOR_BGR2GRAY);
+                else gray = pkt.frame;
+                detectFrame(ctx, gray, pkt.camera, pkt.seq, *currentIdRegistry(), scratch, pkt);
+                resultRing.push(pkt, DropPolicy::Block, running);
+            }
+            activeWorkers.fetch_sub(1);
+        });
+    }
+
+    // Reorder: hold results until every earlier frame has been written
+    std::map<uint64_t, ReplayResult> pending;
+    std::vector<MarkerPose> poses;
+    const std::shared_ptr<const IdRegistry> registry = currentIdRegistry();
+    FramePacket pkt;
+    uint64_t nextOut = 0, markers = 0;
+    const double start = nowMs();
+    double lastProgress = start;
+    for (;;) {
+        bool done = activeWorkers.load() == 0;
+        if (!resultRing.tryPop(pkt)) {
+            if (done) break;
+            idleBackoff();
+            continue;
+        }
+        ReplayResult& r = pending[pkt.seq];
+        r.ids.swap(pkt.ids);
+        r.dicts.swap(pkt.dicts);
+        r.corners.swap(pkt.corners);
+        for (auto it = pending.begin(); it != pending.end() && it->first == nextOut; it = pending.erase(it)) {
+            if (pose) pose->estimate(nextOut, it->second.dicts, it->second.ids, it->second.corners, poses);
+            writeReplayLine(out, nextOut, directory ? src.imagePath((size_t)nextOut) : std::string(), it->second,
+                            *registry, pose ? &poses : nullptr);
+            markers += it->second.ids.size();
+            ++nextOut;
+        }
+        if (!rcfg.outPath.empty() && nowMs() - lastProgress >= 5000.0) {
+            lastProgress = nowMs();
+            std::cout << "Replay: " << nextOut << " frames, "
+                      << cv::format("%.1f", nextOut * 1000.0 / (lastProgress - start)) << " fps" << std::endl;
+        }
+    }
+    running.store(false);
+    if (decoder.joinable()) decoder.join();
+    for (auto& t : pool) t.join();
+    out.flush();
+
+    const double sec = (nowMs() - start) / 1000.0;
+    if (!rcfg.outPath.empty())
+        std::cout << "Replay: " << nextOut << " frames, " << markers << " markers in "
+                  << cv::format("%.1f s (%.1f fps, %d workers)", sec, sec > 0 ? nextOut / sec : 0.0, workers)
+                  << " -> " << rcfg.outPath << std::endl;
+    if (!out) {
+        std::cerr << "写入 " << (rcfg.outPath.empty() ? std::string("stdout") : rcfg.outPath) << " 失败." << std::endl;
+        return 4;
+    }
+    return nextOut > 0 ? 0 : 5;
+}
+// ---- End replay helpers ----
+
+// ---- Result publishing helpers ----
+// One result as a binary record. Timestamps share steady_clock's epoch, which
+// is CLOCK_MONOTONIC on Linux, so consumers can compare them with their own.
+static void fillResultRecord(const FramePacket& pkt, const IdRegistry& registry, ResultRecord& rec) {
+    ResultRecordHeader& h = rec.header;
+    const size_t n = std::min(pkt.ids.size(), (size_t)kMaxRecordMarkers);
+    h.camera = (uint32_t)pkt.camera;
+    h.markerCount = (uint32_t)n;
+    h.seq = pkt.seq;
+    h.sensorNs = (int64_t)(pkt.sensorMs * 1e6);
+    h.captureNs = (int64_t)(pkt.captureMs * 1e6);
+    h.detectMs = (float)pkt.detectMs;
+    h.flags = pkt.ids.size() > n ? kRecordTruncated : 0;
+    const bool hasPose = pkt.poses.size() == pkt.ids.size();
+    for (size_t i = 0; i < n; ++i) {
+        ResultMarker& m = rec.markers[i];
+        m.dict = pkt.dicts[i];
+        m.id = pkt.ids[i];
+        for (int j = 0; j < 4; ++j) {
+            m.corners[2 * j] = pkt.corners[i][j].x;
+            m.corners[2 * j + 1] = pkt.corners[i][j].y;
+        }
+        m.flags = registry.allowed(m.dict, m.id) ? kMarkerAllowed : 0;
+        for (int k = 0; k < 3; ++k) {
+            m.rvec[k] = hasPose ? (float)pkt.poses[i].rvec[k] : 0.0f;
+            m.tvec[k] = hasPose ? (float)pkt.poses[i].tvec[k] : 0.0f;
+        }
+        if (hasPose) m.flags |= kMarkerHasPose;
+        m.reserved = 0;
+    }
+}
+// ---- End result publishing helpers ----
+
+// ---- Multi-camera helpers ----
+// One opened live source with its own capture thread and counters
+struct CameraSource {
+    std::string name;   // index or device path as given on the command line
+    std::string window; // HighGUI window title
+    cv::VideoCapture cap;
+    int width = 0, height = 0;
+    PixelFormat format = PixelFormat::BGR;
+    std::unique_ptr<V4l2Capture> v4l2; // native backend instead of cap (--v4l2)
+    LatestSlot<FramePacket> latest;    // capture -> detect with --latest-frame
+    FpsStats stats;
+    uint64_t nextSeq = 0; // render side: next frame allowed on screen
+    uint64_t shown = 0;   // results consumed (detection throughput)
+    double lastDisplayMs = 0.0;
+    std::unique_ptr<PoseEstimator> pose; // render side, sees results in seq order
+    StageLatency latency;   // render side, whole run
+    StageLatency lastLog;   // copy taken at the previous log line
+    CounterTotals counters;   // render side, whole run
+    CounterTotals counterLog; // since the previous log line
+};
+
+static std::string fourccString(int fcc) {
+    char c[5] = {(char)(fcc & 0xFF), (char)((fcc >> 8) & 0xFF),
+                 (char)((fcc >> 16) & 0xFF), (char)((fcc >> 24) & 0xFF), 0};
+    return c;
+}
+
+static int fourccCode(const std::string& s) {
+    std::string f = (s + "    ").substr(0, 4);
+    return (f[0] & 0xFF) | ((f[1] & 0xFF) << 8) | ((f[2] & 0xFF) << 16) | ((f[3] & 0xFF) << 24);
+}
+
+// Ask the driver for raw YUV and skip OpenCV's BGR conversion. Falls back to
+// BGR when the camera delivers something we cannot take the luma from (MJPG).
+static PixelFormat enableRawCapture(cv::VideoCapture& cap, const std::string& fourcc) {
+    cap.set(cv::CAP_PROP_FOURCC, fourccCode(fourcc));
+    cap.set(cv::CAP_PROP_CONVERT_RGB, 0);
+    std::string got = fourccString((int)cap.get(cv::CAP_PROP_FOURCC));
+    if (got == "YUYV" || got == "YUY2") return PixelFormat::YUYV;
+    if (got == "UYVY") return PixelFormat::UYVY;
+    if (got == "NV12") return PixelFormat::NV12;
+    if (got == "GREY" || got == "Y800") return PixelFormat::GRAY;
+    std::cerr << "摄像头输出格式 " << got << " 不支持灰度直通, 回退到 BGR." << std::endl;
+    cap.set(cv::CAP_PROP_CONVERT_RGB, 1);
+    return PixelFormat::BGR;
+}
+
+struct V4l2Config {
+    bool enabled = false;
+    int buffers = 0;           // driver buffers to mmap, 0 = one per pipeline slot
+    bool exportDmabuf = false;
+};
+
+static PixelFormat pixelFormatFromFourcc(const std::string& f) {
+    if (f == "YUYV") return PixelFormat::YUYV;
+    if (f == "UYVY") return PixelFormat::UYVY;
+    if (f == "NV12") return PixelFormat::NV12;
+    return PixelFormat::GRAY;
+}
+
+static bool openCameraSource(const std::string& spec, int w, int h, const std::string& rawFourcc,
+                             const V4l2Config& vcfg, CameraSource& cam) {
+    cam.name = spec;
+    if (vcfg.enabled) {
+        std::string dev = isNumeric(spec) ? "/dev/video" + spec : spec;
+        cam.v4l2.reset(new V4l2Capture);
+        if (!cam.v4l2->open(dev, w, h, rawFourcc.empty() ? "YUYV" : rawFourcc, vcfg.buffers, vcfg.exportDmabuf)) {
+            std::cerr << "V4L2: " << cam.v4l2->error() << std::endl;
+            cam.v4l2.reset();
+            return false;
+        }
+        cam.format = pixelFormatFromFourcc(cam.v4l2->fourcc());
+        cam.width = cam.v4l2->width();
+        cam.height = cam.v4l2->height();
+        return true;
+    }
+    bool ok = isNumeric(spec) ? tryOpenCamera(std::atoi(spec.c_str()), cam.cap, w, h)
+                              : tryOpenCamera(spec, cam.cap, w, h);
+    if (!ok) return false;
+    if (!rawFourcc.empty()) cam.format = enableRawCapture(cam.cap, rawFourcc);
+    cam.width = (int)cam.cap.get(cv::CAP_PROP_FRAME_WIDTH);
+    cam.height = (int)cam.cap.get(cv::CAP_PROP_FRAME_HEIGHT);
+    return true;
+}
+// ---- End multi-camera helpers ----
+
+// ---- Latency report helpers ----
+// A driver timestamp is only trusted when it is plausibly on steady_clock:
+// not in the future and not older than any frame could sit in a queue.
+static double plausibleSensorMs(double ts, double now) {
+    return ts > 0.0 && ts <= now && now - ts < 5000.0 ? ts : 0.0;
+}
+
+static void logStage(std::ostream& os, const char* name, const LatencyHistogram& h) {
+    if (h.count() == 0) return;
+    os << cv::format("  %s p50 %.2f p99 %.2f ms", name, h.quantileMs(0.5), h.quantileMs(0.99));
+}
+
+static void logCounter(std::ostream& os, const char* name, uint64_t sum, uint64_t frames, uint32_t worst) {
+    os << cv::format("  %s %.1f (max %u)", name, frames ? (double)sum / frames : 0.0, (unsigned)worst);
+}
+
+// Per-frame averages and the worst frame of the detection counters
+static void logCounters(std::ostream& os, const CounterTotals& t) {
+    logCounter(os, "candidates", t.candidates, t.frames, t.worst.candidates);
+    logCounter(os, "rejected", t.rejected, t.frames, t.worst.rejected);
+    logCounter(os, "decode", t.decodeAttempts, t.frames, t.worst.decodeAttempts);
+    logCounter(os, "accepted", t.accepted, t.frames, t.worst.accepted);
+    logCounter(os, "wrong", t.wrong, t.frames, t.worst.wrong);
+}
+
+// Two lines per camera for the interval since its previous lines
+static void logLatency(std::vector<std::unique_ptr<CameraSource>>& cams) {
+    for (auto& cam : cams) {
+        StageLatency& l = cam->latency;
+        StageLatency& prev = cam->lastLog;
+        std::ostringstream line;
+        line << "latency [" << cam->name << "] " << l.captureToDetect.since(prev.captureToDetect).count() << " frames:";
+        logStage(line, "sensor->capture", l.sensorToCapture.since(prev.sensorToCapture));
+        logStage(line, "capture->detect", l.captureToDetect.since(prev.captureToDetect));
+        logStage(line, "detect->output", l.detectToOutput.since(prev.detectToOutput));
+        logStage(line, "display", l.display.since(prev.display));
+        std::cout << line.str() << std::endl;
+        prev = l;
+        if (cam->counterLog.frames == 0) continue;
+        std::ostringstream counts;
+        counts << "counters [" << cam->name << "] per frame:";
+        logCounters(counts, cam->counterLog);
+        std::cout << counts.str() << std::endl;
+        cam->counterLog = CounterTotals();
+    }
+}
+
+// Written to a temporary file and renamed, so a scraper (e.g. node_exporter's
+// textfile collector) never reads half a file
+static void writeMetrics(const std::string& path, const std::vector<std::unique_ptr<CameraSource>>& cams) {
+    const std::string name = "aruco_stage_latency_seconds";
+    std::ostringstream os;
+    os << "# HELP " << name << " Per-frame latency of each pipeline stage.\n"
+       << "# TYPE " << name << " histogram\n";
+    for (const auto& cam : cams) {
+        const std::string camLabel = "camera=\"" + cam->name + "\",stage=";
+        cam->latency.sensorToCapture.writePrometheus(os, name, camLabel + "\"sensor_to_capture\"");
+        cam->latency.captureToDetect.writePrometheus(os, name, camLabel + "\"capture_to_detect\"");
+        cam->latency.detectToOutput.writePrometheus(os, name, camLabel + "\"detect_to_output\"");
+        cam->latency.display.writePrometheus(os, name, camLabel + "\"display\"");
+    }
+    os << "# HELP aruco_frames_detected_total Frames through detection.\n"
+       << "# TYPE aruco_frames_detected_total counter\n";
+    for (const auto& cam : cams)
+        os << "aruco_frames_detected_total{camera=\"" << cam->name << "\"} " << cam->counters.frames << "\n";
+    // Same kinds for the running sums and the worst single frame
+    const char* kinds[] = {"candidates", "rejected", "decode_attempts", "accepted", "wrong"};
+    os << "# HELP aruco_detect_work_total Detection work summed over frames.\n"
+       << "# TYPE aruco_detect_work_total counter\n";
+    for (const auto& cam : cams) {
+        const CounterTotals& t = cam->counters;
+        const uint64_t sums[] = {t.candidates, t.rejected, t.decodeAttempts, t.accepted, t.wrong};
+        for (int k = 0; k < 5; ++k)
+            os << "aruco_detect_work_total{camera=\"" << cam->name << "\",kind=\"" << kinds[k] << "\"} "
+               << sums[k] << "\n";
+    }
+    os << "# HELP aruco_detect_work_frame_max Most detection work seen in one frame.\n"
+       << "# TYPE aruco_detect_work_frame_max gauge\n";
+    for (const auto& cam : cams) {
+        const DetectCounters& w = cam->counters.worst;
+        const uint32_t worst[] = {w.candidates, w.rejected, w.decodeAttempts, w.accepted, w.wrong};
+        for (int k = 0; k < 5; ++k)
+            os << "aruco_detect_work_frame_max{camera=\"" << cam->name << "\",kind=\"" << kinds[k] << "\"} "
+               << worst[k] << "\n";
+    }
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp.c_str());
+        if (!out) return;
+        out << os.str();
+    }
+    std::rename(tmp.c_str(), path.c_str());
+}
+// ---- End latency report helpers ----
+
 int main(int argc, char** argv) {
-    // Constants for clarity
-    const int kFrameWidth = 640;
-    const int kFrameHeight = 480;
+    // Defaults for clarity; --size overrides the capture resolution
+    int frameWidth = 640;
+    int frameHeight = 480;
+    std::string rawFourcc; // non-empty: grayscale-native capture (--gray)
     const char* kWindowTitle = "Aruco Detect";
 
-    // Parse optional input source
-    // Usage now: ./aruco_demo [--list] [0|1]
-    if (argc >= 2 && std::string(argv[1]) == "--list") {
-        listCameras(2); // only probe 0 and 1
-        return 0;
+    // Parse optional input source and pipeline options
+    // Usage now: ./aruco_demo [--list [N]] [--workers N] [--queue N]
+    //                         [--drop oldest|newest|block] [--latest-frame]
+    //                         [--track] [--track-interval N]
+    //                         [--size WxH] [--pyramid] [--marker-px N]
+    //                         [--bench VIDEO|DIR [--bench-json FILE]] [--no-gui]
+    //                         [--synthetic N[,N...] [--synthetic-frames N]]
+    //                         [--display-fps N] [--no-overlay] [--fast-overlay]
+    //                         [--show-rejected] [--gray [--fourcc CODE]]
+    //                         [--v4l2 [--v4l2-buffers N] [--v4l2-dmabuf]]
+    //                         [--budget MS] [--fast-detect] [--opencl] [--ids FILE]
+    //                         [--dict NAME[,NAME...]]
+    //                         [--calib FILE [--marker-length M]]
+    //                         [--publish-shm NAME [--shm-slots N]] [--publish-udp ADDR:PORT]
+    //                         [--latency-log SEC] [--metrics FILE] [--trace FILE]
+    //                         [--replay VIDEO|DIR [--replay-out FILE]]
+    //                         [INDEX|/dev/videoN ...]
+    PipelineConfig pcfg;
+    DisplayConfig dcfg;
+    V4l2Config vcfg;
+    BudgetConfig budgetCfg;
+    PoseConfig poseCfg;
+    PublishConfig pubCfg;
+    LatencyReportConfig latCfg;
+    ReplayConfig rcfg;
+    BenchConfig bcfg;
+    TrackerConfig tcfg;
+    PyramidConfig pyrCfg;
+    bool fastFrontEnd = false;
+    bool openCL = false; // threshold on the OpenCL device (--opencl)
+    std::string idsPath; // allow-list config, reloaded on SIGUSR1
+    std::vector<int> activeDicts; // --dict, in decode priority order
+    std::vector<std::string> cameraSpecs; // one capture thread per entry
+    for (int a = 1; a < argc; ++a) {
+        std::string arg = argv[a];
+        if (arg == "--list") {
+            int probe = (a + 1 < argc && isNumeric(argv[a + 1])) ? std::atoi(argv[a + 1]) : 16;
+            listCameras(probe);
+            return 0;
+        }
+        if (arg == "--latest-frame") {
+            pcfg.latestFrame = true;
+            continue;
+        }
+        if (arg == "--track") {
+            tcfg.enabled = true;
+            continue;
+        }
+        if (arg == "--no-gui") {
+            dcfg.gui = false;
+            continue;
+        }
+        if (arg == "--v4l2" || arg == "--v4l2-dmabuf") {
+            vcfg.enabled = true;
+            if (arg == "--v4l2-dmabuf") vcfg.exportDmabuf = true;
+            continue;
+        }
+        if (arg == "--gray") {
+            if (rawFourcc.empty()) rawFourcc = "YUYV";
+            continue;
+        }
+        if (arg == "--no-overlay" || arg == "--fast-overlay" || arg == "--show-rejected") {
+            if (arg == "--no-overlay") dcfg.overlay = false;
+            else if (arg == "--fast-overlay") dcfg.antialias = false;
+            else dcfg.showRejected = true;
+            continue;
+        }
+        if (arg == "--pyramid") {
+            pyrCfg.enabled = true;
+            continue;
+        }
+        if (arg == "--fast-detect") {
+            fastFrontEnd = true;
+            continue;
+        }
+        if (arg == "--opencl") {
+            openCL = true;
+            continue;
+        }
+        if (arg == "--size") {
+            if (a + 1 >= argc ||
+                std::sscanf(argv[a + 1], "%dx%d", &frameWidth, &frameHeight) != 2 ||
+                frameWidth <= 0 || frameHeight <= 0) {
+                std::cerr << "参数 --size 需要形如 1920x1080 的分辨率." << std::endl;
+                return 2;
+            }
+            ++a;
+            continue;
+        }
+        if (arg == "--workers" || arg == "--queue" || arg == "--drop" ||
+            arg == "--track-interval" || arg == "--marker-px" ||
+            arg == "--bench" || arg == "--bench-json" || arg == "--display-fps" ||
+            arg == "--fourcc" || arg == "--v4l2-buffers" || arg == "--budget" ||
+            arg == "--ids" || arg == "--dict" || arg == "--calib" || arg == "--marker-length" ||
+            arg == "--publish-shm" || arg == "--shm-slots" || arg == "--publish-udp" ||
+            arg == "--latency-log" || arg == "--metrics" || arg == "--trace" || arg == "--replay" || arg == "--replay-out" ||
+            arg == "--synthetic" || arg == "--synthetic-frames") {
+            if (a + 1 >= argc) {
+                std::cerr << "参数 " << arg << " 缺少取值." << std::endl;
+                return 2;
+            }
+            std::string val = argv[++a];
+            if (arg == "--bench") { bcfg.input = val; continue; }
+            if (arg == "--replay") { rcfg.input = val; continue; }
+            if (arg == "--replay-out") { rcfg.outPath = val; continue; }
+            if (arg == "--fourcc") {
+                if (val.size() != 4) {
+                    std::cerr << "参数 --fourcc 需要 4 个字符, 例如 YUYV 或 NV12." << std::endl;
+                    return 2;
+                }
+                rawFourcc = val;
+                continue;
+            }
+            if (arg == "--bench-json") { bcfg.jsonPath = val; continue; }
+            if (arg == "--ids") { idsPath = val; continue; }
+            if (arg == "--calib") { poseCfg.calibPath = val; continue; }
+            if (arg == "--publish-shm") { pubCfg.shmName = val; continue; }
+            if (arg == "--publish-udp") { pubCfg.udpTarget = val; continue; }
+            if (arg == "--metrics") { latCfg.metricsPath = val; continue; }
+            if (arg == "--trace") { latCfg.tracePath = val; continue; }
+            if (arg == "--marker-length") {
+                poseCfg.markerLength = std::atof(val.c_str());
+                if (poseCfg.markerLength <= 0) {
+                    std::cerr << "参数 --marker-length 必须为正数 (米)." << std::endl;
+                    return 2;
+                }
+                continue;
+            }
+            if (arg == "--dict") {
+                std::istringstream names(val);
+                std::string name;
+                while (std::getline(names, name, ',')) {
+                    const DictName* d = findDictName(name);
+                    if (!d) {
+                        std::cerr << "未知字典 " << name << " (例如 DICT_4X4_50, DICT_6X6_50)." << std::endl;
+                        return 2;
+                    }
+                    if (std::find(activeDicts.begin(), activeDicts.end(), d->id) == activeDicts.end())
+                        activeDicts.push_back(d->id);
+                }
+                continue;
+            }
+            if (arg == "--synthetic") {
+                std::istringstream counts(val);
+                std::string count;
+                while (std::getline(counts, count, ',')) {
+                    if (!isNumeric(count)) {
+                        std::cerr << "参数 --synthetic 需要以逗号分隔的每帧标记数, 例如 1,8,32." << std::endl;
+                        return 2;
+                    }
+                    bcfg.synthetic.push_back(std::atoi(count.c_str()));
+                }
+                continue;
+            }
+            if (arg == "--drop") {
+                if (!parseDropPolicy(val, pcfg.drop)) {
+                    std::cerr << "无效的丢帧策略 " << val
+                              << ". 可选: oldest, newest, block." << std::endl;
+                    return 2;
+                }
+                continue;
+            }
+            if (arg == "--budget") {
+                budgetCfg.targetMs = std::atof(val.c_str());
+                if (budgetCfg.targetMs <= 0) {
+                    std::cerr << "参数 --budget 必须为正数 (毫秒)." << std::endl;
+                    return 2;
+                }
+                continue;
+            }
+            int n = std::atoi(val.c_str());
+            if (n < 1) {
+                std::cerr << "参数 " << arg << " 必须为正整数." << std::endl;
+                return 2;
+            }
+            if (arg == "--workers") pcfg.workers = rcfg.workers = n;
+            else if (arg == "--queue") pcfg.queueDepth = n;
+            else if (arg == "--track-interval") tcfg.fullScanInterval = n;
+            else if (arg == "--display-fps") dcfg.maxFps = n;
+            else if (arg == "--v4l2-buffers") vcfg.buffers = n;
+            else if (arg == "--shm-slots") pubCfg.shmSlots = n;
+            else if (arg == "--latency-log") latCfg.logSec = n;
+            else if (arg == "--synthetic-frames") bcfg.syntheticFrames = n;
+            else pyrCfg.expectedMarkerPx = n;
+            continue;
+        }
+        if (!isNumeric(arg) && arg.compare(0, 5, "/dev/") != 0) {
+            std::cerr << "仅支持摄像头索引或 /dev/video* 设备路径 "
+                      << "(录制的视频/图片目录请使用 --bench 或 --replay)." << std::endl;
+            return 2;
+        }
+        cameraSpecs.push_back(arg);
     }
 
-    int requestedIndex = -1;
-    if (argc >= 2) {
-        std::string arg = argv[1];
-        bool numeric = !arg.empty() &&
-                       std::all_of(arg.begin(), arg.end(), [](unsigned char c){ return std::isdigit(c); });
-        if (!numeric) {
-            std::cerr << "仅支持摄像头索引 0 或 1 (不支持图片/视频路径)." << std::endl;
+    // Signals and terminal keys are handled on a dedicated thread, started
+    // first so that every later thread inherits the blocked signal mask
+    InputWatcher inputWatcher;
+    if (!inputWatcher.start(bcfg.input.empty() && bcfg.synthetic.empty() && rcfg.input.empty())) {
+        std::cerr << "无法初始化信号/键盘监听." << std::endl;
+        return 4;
+    }
+
+    // DICT_6X6_50 unless --dict names others
+    if (activeDicts.empty()) activeDicts.push_back(cv::aruco::DICT_6X6_50);
+    std::vector<DecodeDictionary> decodeDicts = makeDecodeDictionaries(activeDicts);
+    if (activeDicts.size() > 1 && !fastFrontEnd) {
+        // detectMarkers decodes a single dictionary; the in-tree front end decodes many
+        std::cout << "Multiple dictionaries: using the in-tree front end (--fast-detect)" << std::endl;
+        fastFrontEnd = true;
+    }
+
+    // Tune detection parameters slightly for better recall on small markers
+    cv::Ptr<cv::aruco::DetectorParameters> detParams = defaultDetectorParameters();
+    if (!reloadIdRegistry(idsPath, activeDicts)) return 2;
+
+    // Pose stage: one calibration shared by every camera
+    CameraIntrinsics intrinsics;
+    FrameContext fc;
+    if (!poseCfg.calibPath.empty()) {
+        std::string error;
+        if (!intrinsics.load(poseCfg.calibPath, error)) {
+            std::cerr << error << std::endl;
             return 2;
         }
-        requestedIndex = std::stoi(arg);
-        if (requestedIndex < 0 || requestedIndex > 1) {
-            std::cerr << "无效的摄像头索引 " << requestedIndex
-                      << ". 仅支持 0 或 1." << std::endl;
-            return 2;
+        fc.intrinsics = &intrinsics;
+        fc.axisLength = (float)(poseCfg.markerLength * 0.5);
+    }
+    if (openCL) {
+        // The device path is part of the in-tree front end
+        if (openclDevice().empty()) {
+            std::cerr << "未找到可用的 OpenCL 设备, 改用 CPU 阈值." << std::endl;
+            openCL = false;
+        } else {
+            // The probe leaves the T-API as it found it; --opencl is the choice to use it
+            cv::ocl::setUseOpenCL(true);
+            fastFrontEnd = true;
         }
     }
+    if (fastFrontEnd)
+        std::cout << "Detector front end: in-tree (threshold "
+                  << (openCL ? "opencl on " + openclDevice() : std::string(thresholdIsa())) << ", hamming "
+                  << HammingDecoder::popcountIsa() << ")" << std::endl;
 
-    cv::VideoCapture cap;
+    // Headless benchmark: recorded input, no window, JSON report
+    if (!bcfg.input.empty() || !bcfg.synthetic.empty()) {
+        DetectionContext benchCtx;
+        benchCtx.dicts = decodeDicts;
+        benchCtx.params = detParams;
+        benchCtx.fastFrontEnd = fastFrontEnd;
+        benchCtx.openCL = openCL;
+        bcfg.syntheticSize = cv::Size(frameWidth, frameHeight);
+        return runBenchmark(bcfg, benchCtx, tcfg, pyrCfg, dcfg, poseCfg, fc);
+    }
 
-    if (requestedIndex >= 0) {
-        if (!tryOpenCamera(requestedIndex, cap, 640, 480)) {
-            std::cerr << "无法打开摄像头索引 " << requestedIndex
-                      << " (仅支持 0 或 1)." << std::endl;
-            return 3;
+    // Offline replay: recorded input in, per-frame detections out
+    if (!rcfg.input.empty()) {
+        DetectionContext replayCtx;
+        replayCtx.dicts = decodeDicts;
+        replayCtx.params = detParams;
+        replayCtx.fastFrontEnd = fastFrontEnd;
+        replayCtx.openCL = openCL;
+        std::unique_ptr<PoseEstimator> replayPose;
+        if (fc.intrinsics) replayPose.reset(new PoseEstimator(intrinsics, poseCfg.markerLength));
+        return runReplay(rcfg, replayCtx, pyrCfg, replayPose.get());
+    }
+
+    // Every pipeline slot can hold a leased driver buffer. The rings are
+    // shared (queueDepth per camera each), so one camera may fill both; add
+    // each worker, the capture and render stages, the latest-frame slot and
+    // one left for the driver. A driver that grants fewer only makes capture
+    // wait for a lease to come back.
+    const int numSpecs = std::max<int>(1, (int)cameraSpecs.size());
+    if (vcfg.enabled && vcfg.buffers == 0) vcfg.buffers = 2 * pcfg.queueDepth * numSpecs + pcfg.workers + 4;
+
+    std::vector<std::unique_ptr<CameraSource>> cams;
+    if (!cameraSpecs.empty()) {
+        for (const std::string& spec : cameraSpecs) {
+            std::unique_ptr<CameraSource> cam(new CameraSource);
+            if (!openCameraSource(spec, frameWidth, frameHeight, rawFourcc, vcfg, *cam)) {
+                std::cerr << "无法打开摄像头 " << spec << "." << std::endl;
+                return 3;
+            }
+            cams.push_back(std::move(cam));
         }
     } else {
         // No argument: try 0 then 1 only
-        int indices[2] = {0,1};
-        bool opened = false;
-        for (int idx : indices) {
-            if (tryOpenCamera(idx, cap, 640, 480)) { opened = true; break; }
+        const char* defaults[2] = {"0", "1"};
+        for (const char* spec : defaults) {
+            std::unique_ptr<CameraSource> cam(new CameraSource);
+            if (openCameraSource(spec, frameWidth, frameHeight, rawFourcc, vcfg, *cam)) { cams.push_back(std::move(cam)); break; }
         }
-        if (!opened) {
+        if (cams.empty()) {
             std::cerr << "无法打开摄像头 (仅尝试 /dev/video0 与 /dev/video1).\n"
                       << "提示:\n"
-                      << "  1) 运行: ./aruco_demo --list 查看可用设备 (仅列出 0,1)\n"
-                      << "  2) 指定: ./aruco_demo 0  或  ./aruco_demo 1\n"
-                      << "  3) 现在已不支持文件/图片/URL 输入\n";
+                      << "  1) 运行: ./aruco_demo --list 查看可用设备\n"
+                      << "  2) 指定: ./aruco_demo 0  或  ./aruco_demo 0 1 /dev/video4\n"
+                      << "  3) 录制的视频/图片目录请使用 --bench\n";
             return 1;
         }
     }
+    const int numCams = (int)cams.size();
+    for (int c = 0; c < numCams; ++c) {
+        cams[c]->window = numCams == 1 ? std::string(kWindowTitle)
+                                       : cv::format("%s [%s]", kWindowTitle, cams[c]->name.c_str());
+        if (fc.intrinsics) cams[c]->pose.reset(new PoseEstimator(intrinsics, poseCfg.markerLength));
+    }
 
-    // Use only DICT_6X6_50
-    auto dict6x6_50 = cv::aruco::getPredefinedDictionary(cv::aruco::DICT_6X6_50);
-    const char* dict6x6_50_name = "6X6_50";
+    // Binary results for other processes, written before any GUI work
+    ResultPublisher publisher;
+    if (!pubCfg.shmName.empty() || !pubCfg.udpTarget.empty()) {
+        if (!publisher.open(pubCfg.shmName, pubCfg.shmSlots, pubCfg.udpTarget)) {
+            std::cerr << publisher.error() << std::endl;
+            return 2;
+        }
+        if (!pubCfg.shmName.empty())
+            std::cout << "Publishing results to shared memory " << pubCfg.shmName << " (" << pubCfg.shmSlots
+                      << " slots of " << sizeof(ShmSlot) << " bytes)" << std::endl;
+        if (!pubCfg.udpTarget.empty()) std::cout << "Publishing results to UDP " << pubCfg.udpTarget << std::endl;
+    }
 
-    // Tune detection parameters slightly for better recall on small markers
-    cv::Ptr<cv::aruco::DetectorParameters> detParams = cv::aruco::DetectorParameters::create();
-    detParams->adaptiveThreshWinSizeMin = 3;
-    detParams->adaptiveThreshWinSizeMax = 23;
-    detParams->adaptiveThreshWinSizeStep = 10;
-    detParams->minMarkerPerimeterRate = 0.01f; // detect smaller markers
-    detParams->maxMarkerPerimeterRate = 4.0f;
-    detParams->polygonalApproxAccuracyRate = 0.05;
+    // Parallelism comes from the worker pool; keep OpenCV's own pool from
+    // oversubscribing the cores when several detectors run at once.
+    if (pcfg.workers > 1) cv::setNumThreads(1);
+
+    // Stage links: capture (one thread per camera) -> detect pool -> render (this thread)
+    const int camW = cams[0]->width;
+    const int camH = cams[0]->height;
+    // Raw-format buffers take their shape from the first read instead
+    auto preallocFrame = [&](FramePacket& p) {
+        if (camW > 0 && camH > 0 && cams[0]->format == PixelFormat::BGR) p.frame.create(camH, camW, CV_8UC3);
+        p.ids.reserve(64); p.corners.reserve(64); p.rejected.reserve(64);
+    };
+
+    std::vector<std::unique_ptr<RoiTracker>> trackers;
+    SharedDetectorParams liveParams(detParams);
+    ParamAutoTuner tuner(budgetCfg, *detParams, liveParams);
+    DetectionContext detCtx;
+    detCtx.dicts = decodeDicts;
+    detCtx.params = detParams;
+    detCtx.fastFrontEnd = fastFrontEnd;
+    detCtx.openCL = openCL;
+    if (tuner.enabled()) detCtx.liveParams = &liveParams;
+    detCtx.cameras.resize(numCams);
+    for (int c = 0; c < numCams; ++c) {
+        const CameraSource& cam = *cams[c];
+        trackers.emplace_back(new RoiTracker(tcfg));
+        detCtx.cameras[c].tracker = trackers.back().get();
+        if (pyrCfg.enabled && cam.width > 0 && cam.height > 0) {
+            int level = choosePyramidLevel(cv::Size(cam.width, cam.height), *detParams, pyrCfg.expectedMarkerPx);
+            detCtx.cameras[c].pyramidLevel = level;
+            std::cout << "Pyramid [" << cam.name << "]: " << cam.width << "x" << cam.height
+                      << " -> level " << level << " (" << (cam.width >> level) << "x"
+                      << (cam.height >> level) << ")\n";
+            if (level == 0) warnPyramidLevel0(cv::Size(cam.width, cam.height));
+        }
+    }
 
-    Mat frame;
+    FrameRing<FramePacket> captureRing(pcfg.queueDepth * numCams);
+    FrameRing<FramePacket> resultRing(pcfg.queueDepth * numCams);
+    captureRing.preallocate(preallocFrame);
+    resultRing.preallocate(preallocFrame);
+    if (pcfg.latestFrame)
+        for (auto& cam : cams) cam->latest.preallocate(preallocFrame);
+    // Frames lost to a full queue or replaced in a latest-frame slot
+    auto droppedFrames = [&]() {
+        uint64_t n = captureRing.dropped() + resultRing.dropped();
+        for (const auto& cam : cams) n += cam->latest.dropped();
+        return n;
+    };
 
     // Enable terminal key handling with RAII
     TerminalRawGuard terminalGuard;
 
-    // Register signal handlers for clean exit (restores terminal)
-    signal(SIGINT, handleSignal);
-    signal(SIGTERM, handleSignal);
-    signal(SIGHUP, handleSignal);
-
-    FpsStats stats;
-    
-    while (true) {
-        double start = nowMs(); // start timing this frame
+    std::atomic<bool> running(true);
+    std::atomic<int> activeCaptures(numCams);
+    std::atomic<int> activeWorkers(pcfg.workers);
+    if (!latCfg.tracePath.empty()) {
+        traceEnable();
+        traceThreadName("render");
+    }
 
-        if (!cap.read(frame) || frame.empty()) break;
+    std::vector<std::thread> captureThreads;
+    for (int c = 0; c < numCams; ++c) {
+        captureThreads.emplace_back([&, c]() {
+            cv::VideoCapture& cap = cams[c]->cap;
+            V4l2Capture* v4l2 = cams[c]->v4l2.get();
+            const PixelFormat format = cams[c]->format;
+            FramePacket pkt;
+            preallocFrame(pkt);
+            uint64_t seq = 0;
+            double driverMs = 0.0;
+            traceThreadName("capture " + cams[c]->name);
+            while (running.load(std::memory_order_relaxed)) {
+                // Includes the wait for the driver's next frame
+                const double readStartMs = nowMs();
+                if (v4l2) {
+                    // Zero-copy: pkt.frame is a view over the dequeued driver buffer
+                    V4l2Capture::ReadStatus st = v4l2->read(pkt.frame, pkt.lease, driverMs);
+                    if (st == V4l2Capture::ReadStatus::Timeout) continue;
+                    if (st == V4l2Capture::ReadStatus::Error) {
+                        std::cerr << "V4L2 [" << cams[c]->name << "]: " << v4l2->error() << std::endl;
+                        break;
+                    }
+                } else if (!cap.read(pkt.frame) || pkt.frame.empty()) {
+                    break;
+                } else {
+                    // The V4L backend reports the buffer timestamp here
+                    driverMs = cap.get(cv::CAP_PROP_POS_MSEC);
+                }
+                pkt.seq = seq++;
+                pkt.camera = c;
+                pkt.format = format;
+                pkt.size = format == PixelFormat::BGR ? pkt.frame.size()
+                                                      : cv::Size(cams[c]->width, cams[c]->height);
+                pkt.captureMs = nowMs();
+                pkt.sensorMs = plausibleSensorMs(driverMs, pkt.captureMs);
+                traceRecord("capture", readStartMs, pkt.captureMs, c, pkt.seq);
+                if (pcfg.latestFrame) cams[c]->latest.push(pkt);
+                else captureRing.push(pkt, pcfg.drop, running);
+                // Whatever came back (recycled slot, evicted or dropped frame)
+                // may still pin a driver buffer
+                releaseLease(pkt);
+            }
+            releaseLease(pkt);
+            activeCaptures.fetch_sub(1);
+        });
+    }
 
-        // Only allow IDs 3 and 7 with special names
-        static const std::unordered_map<int, std::string> kSpecialNames = {
-            {3, "Three's Company"},
-            {7, "Lucky Number Seven"}
-        };
-        
-        // NEW: correct (allowed) ID containers (replaces former allIds/allCorners/labels)
-        std::vector<int> correctIds; correctIds.reserve(64);
-        std::vector<std::vector<cv::Point2f>> correctCorners; correctCorners.reserve(64);
-        std::vector<std::string> correctLabels; correctLabels.reserve(64);
-
-        // Existing: wrong (disallowed) IDs
-        std::vector<int> wrongIds; wrongIds.reserve(64);
-        std::vector<std::vector<cv::Point2f>> wrongCorners; wrongCorners.reserve(64) ;
-        std::vector<std::string> wrongLabels; wrongLabels.reserve(64);
-
-        // Rejected candidates (no ID decoded)
-        std::vector<std::vector<cv::Point2f>> rejectedCorners; rejectedCorners.reserve(64);
-
-        std::vector<int> ids;
-        std::vector<std::vector<cv::Point2f>> corners;
-        cv::aruco::detectMarkers(frame, dict6x6_50, corners, ids, detParams, rejectedCorners);
-        if (!ids.empty()) {
-            for (size_t k = 0; k < ids.size(); ++k) {
-                auto it = kSpecialNames.find(ids[k]);
-                if (it == kSpecialNames.end()) {
-                    wrongCorners.push_back(corners[k]);
-                    wrongIds.push_back(ids[k]);
-                    wrongLabels.emplace_back(cv::format("Wrong_ID_%d", ids[k]));
+    std::vector<std::thread> detectThreads;
+    for (int w = 0; w < pcfg.workers; ++w) {
+        detectThreads.emplace_back([&, w]() {
+            FramePacket pkt;
+            preallocFrame(pkt);
+            DetectScratch scratch;
+            cv::Mat lumaBuf;
+            int nextCam = 0; // latest-frame mode: round robin over the camera slots
+            traceThreadName("detect " + std::to_string(w));
+            auto takeFrame = [&]() {
+                if (!pcfg.latestFrame) return captureRing.tryPop(pkt);
+                for (int i = 0; i < numCams; ++i) {
+                    int c = nextCam;
+                    nextCam = (nextCam + 1) % numCams;
+                    if (cams[c]->latest.tryPop(pkt)) return true;
+                }
+                return false;
+            };
+            while (running.load(std::memory_order_relaxed)) {
+                // Read the flag before popping so the last frame isn't missed
+                bool done = activeCaptures.load() == 0;
+                if (!takeFrame()) {
+                    if (done) break;
+                    idleBackoff();
+                    continue;
+                }
+                double start = nowMs();
+                const std::shared_ptr<const IdRegistry> registry = currentIdRegistry();
+                if (pkt.format == PixelFormat::BGR) {
+                    detectFrame(detCtx, pkt.frame, pkt.camera, pkt.seq, *registry, scratch, pkt);
                 } else {
-                    correctCorners.push_back(corners[k]);
-                    correctIds.push_back(ids[k]);
-                    correctLabels.emplace_back(it->second);
+                    cv::Mat luma = lumaView(pkt.frame, pkt.format, pkt.size, lumaBuf);
+                    detectFrame(detCtx, luma, pkt.camera, pkt.seq, *registry, scratch, pkt);
                 }
+                pkt.detectDoneMs = nowMs();
+                pkt.detectMs = pkt.detectDoneMs - start;
+                traceRecord("detect", start, pkt.detectDoneMs, pkt.camera, pkt.seq, &pkt.counters);
+                // Headless: pixels are no longer needed, requeue right away
+                if (!dcfg.gui) releaseLease(pkt);
+                resultRing.push(pkt, pcfg.drop, running);
+                releaseLease(pkt);
             }
-        }
+            releaseLease(pkt);
+            activeWorkers.fetch_sub(1);
+        });
+    }
+
+    FpsStats combined;
+    FramePacket pkt;
+    cv::Mat display; // color canvas for raw-format packets
+    std::string statsText;
+    char statsBuf[200];
+    bool windowShown = false;
+    const double runStart = nowMs();
+    double lastLatencyLogMs = runStart;
+    double lastMetricsMs = runStart;
 
-        // Draw correct (allowed) markers
-        if (!correctIds.empty()) {
-            cv::aruco::drawDetectedMarkers(frame, correctCorners, correctIds, cv::Scalar(153, 0, 255));
-            // Combined loop: draw thicker border + label
-            for (size_t i = 0; i < correctCorners.size(); ++i) {
-                const auto& pts = correctCorners[i];
-                std::vector<cv::Point> poly;
-                poly.reserve(pts.size());
-                for (const auto& p : pts) poly.push_back(p);
-                const cv::Point* ptsArr = poly.data();
-                int npts = static_cast<int>(poly.size());
-                cv::polylines(frame, &ptsArr, &npts, 1, true, cv::Scalar(153, 0, 255), 6, cv::LINE_AA);
-                cv::Point2f c(0,0);
-                for (const auto& p : pts) c += p;
-                c *= 0.25f;
-                cv::putText(frame, correctLabels[i], c + cv::Point2f(-20, -10),
-                            cv::FONT_HERSHEY_DUPLEX, 0.5, cv::Scalar(153, 0, 255), 1.5, cv::LINE_AA);
+    while (true) {
+        bool workersDone = activeWorkers.load() == 0;
+        // SIGUSR1: swap in a fresh allow-list; capture and detection keep running
+        if (g_reloadRequested.exchange(false)) reloadIdRegistry(idsPath, activeDicts);
+        fc.registry = currentIdRegistry();
+        // Show everything that is ready, then service the GUI once
+        int shownNow = 0;
+        for (;;) {
+            // The previous result has been shown (imshow copies); let its
+            // driver buffer go before taking the next one
+            releaseLease(pkt);
+            if (shownNow >= numCams * 2 || !resultRing.tryPop(pkt)) break;
+            CameraSource& cam = *cams[pkt.camera];
+            ++cam.shown;
+            ++shownNow;
+
+            // Stats follow every result, not only the ones that get displayed
+            double camFps = cam.stats.tickFps();
+            double allFps = combined.tickFps();
+            double avgLatency = cam.stats.updateAvgMs(nowMs() - pkt.captureMs);
+            if (pkt.sensorMs > 0) cam.latency.sensorToCapture.record(pkt.captureMs - pkt.sensorMs);
+            cam.latency.captureToDetect.record(pkt.detectDoneMs - pkt.captureMs);
+            cam.counters.add(pkt.counters);
+            cam.counterLog.add(pkt.counters);
+            tuner.update(pkt.detectMs, pkt.rejected.size());
+            if (cam.pose) {
+                TraceScope scope("pose", pkt.camera, pkt.seq);
+                cam.pose->estimate(pkt.seq, pkt.dicts, pkt.ids, pkt.corners, pkt.poses);
             }
-        }
+            if (publisher.enabled()) {
+                TraceScope scope("publish", pkt.camera, pkt.seq);
+                fillResultRecord(pkt, *fc.registry, publisher.next());
+                publisher.publish();
+            }
+            const double outputMs = nowMs();
+            cam.latency.detectToOutput.record(outputMs - pkt.detectDoneMs);
+
+            if (!dcfg.gui) continue;
+            // Workers finish out of order; never step a display backwards.
+            // Late frames were still counted, posed and published above.
+            if (pkt.seq < cam.nextSeq) continue;
+            cam.nextSeq = pkt.seq + 1;
+            // Display runs at its own capped rate; frames in between are
+            // detected and counted but never drawn
+            double now = nowMs();
+            if (dcfg.maxFps > 0 && now - cam.lastDisplayMs < 1000.0 / dcfg.maxFps) continue;
+            cam.lastDisplayMs = now;
+            // Raw captures are converted to color only here, for shown frames
+            if (pkt.format != PixelFormat::BGR) toBgr(pkt.frame, pkt.format, pkt.size, display);
+            cv::Mat& canvas = pkt.format == PixelFormat::BGR ? pkt.frame : display;
+            const double overlayStartMs = nowMs();
+            int allowed = renderOverlay(canvas, pkt, fc, dcfg);
 
-        // Draw wrong IDs
-        if (!wrongIds.empty()) {
-            cv::aruco::drawDetectedMarkers(frame, wrongCorners, wrongIds, cv::Scalar(0, 0, 255));
-            // Combined loop: draw thicker border + label
-            for (size_t i = 0; i < wrongCorners.size(); ++i) {
-                const auto& pts = wrongCorners[i];
-                std::vector<cv::Point> poly;
-                poly.reserve(pts.size());
-                for (const auto& p : pts) poly.push_back(p);
-                const cv::Point* ptsArr = poly.data();
-                int npts = static_cast<int>(poly.size());
-                cv::polylines(frame, &ptsArr, &npts, 1, true, cv::Scalar(0, 0, 255), 6, cv::LINE_AA);
-                cv::Point2f c(0,0);
-                for (const auto& p : pts) c += p;
-                c *= 0.25f;
-                cv::putText(frame, wrongLabels[i], c + cv::Point2f(-20, -10),
-                            cv::FONT_HERSHEY_DUPLEX, 0.5, cv::Scalar(0, 0, 255), 1, cv::LINE_AA);
+            uint64_t dropped = droppedFrames();
+            std::snprintf(statsBuf, sizeof(statsBuf), "lat %.2f ms  detect %.2f ms%s  fps %.1f  det %d  drop %llu",
+                          avgLatency, pkt.detectMs, pkt.fullScan ? "" : " (roi)",
+                          camFps, allowed, (unsigned long long)dropped);
+            statsText.assign(statsBuf); // reuses capacity
+            cv::putText(canvas, statsText, cv::Point(10, 30),
+                        cv::FONT_HERSHEY_SIMPLEX, 0.6, cv::Scalar(0,255,0), 2);
+            if (numCams > 1 || tuner.enabled()) {
+                std::snprintf(statsBuf, sizeof(statsBuf), "cam %s  all %d cams %.1f fps",
+                              cam.name.c_str(), numCams, allFps);
+                statsText.assign(statsBuf);
+                if (tuner.enabled()) statsText += cv::format("  tune L%d", tuner.level());
+                cv::putText(canvas, statsText, cv::Point(10, 55),
+                            cv::FONT_HERSHEY_SIMPLEX, 0.6, cv::Scalar(0,255,0), 2);
             }
+
+            traceRecord("overlay", overlayStartMs, nowMs(), pkt.camera, pkt.seq);
+            {
+                TraceScope scope("imshow", pkt.camera, pkt.seq);
+                cv::imshow(cam.window, canvas);
+            }
+            windowShown = true;
+            cam.latency.display.record(nowMs() - outputMs);
+        }
+        if (latCfg.logSec > 0 && nowMs() - lastLatencyLogMs >= latCfg.logSec * 1000.0) {
+            lastLatencyLogMs = nowMs();
+            logLatency(cams);
         }
-        
-        // Draw rejected candidate quadrilaterals (failed final ID / criteria)
-        if (!rejectedCorners.empty()) 
-            cv::aruco::drawDetectedMarkers(frame, rejectedCorners, cv::noArray(), cv::Scalar(60, 60, 255));
-        
-        double dur = nowMs() - start;
-        std::string statsText = cv::format("avg %.2f ms  fps %.1f  det %d",
-                                           stats.updateAvgMs(dur), stats.tickFps(), (int)correctLabels.size());
-        cv::putText(frame, statsText, cv::Point(10, 30),
-                    cv::FONT_HERSHEY_SIMPLEX, 0.8, cv::Scalar(0,255,0), 2);
-
-        cv::imshow(kWindowTitle, frame);
-        int key = cv::waitKey(1);
+        if (!latCfg.metricsPath.empty() && nowMs() - lastMetricsMs >= 5000.0) {
+            lastMetricsMs = nowMs();
+            writeMetrics(latCfg.metricsPath, cams);
+        }
+        if (shownNow == 0 && workersDone) break;
+        if (!windowShown && shownNow == 0) idleBackoff();
+        int key = windowShown ? cv::waitKey(1) : -1;
         if (exitRequested(key)) break;
     }
 
+    running.store(false);
+    for (auto& t : captureThreads) t.join();
+    for (auto& t : detectThreads) t.join();
+
+    // Last figures cover the tail of the run
+    if (latCfg.logSec > 0) logLatency(cams);
+    if (!latCfg.metricsPath.empty()) writeMetrics(latCfg.metricsPath, cams);
+    if (!latCfg.tracePath.empty()) {
+        std::vector<std::string> names;
+        for (const auto& cam : cams) names.push_back(cam->name);
+        std::string error;
+        if (traceWrite(latCfg.tracePath, names, error)) std::cout << "Wrote trace " << latCfg.tracePath << "\n";
+        else std::cerr << error << std::endl;
+    }
+
+    // Per-camera and combined throughput over the whole run
+    double runSec = (nowMs() - runStart) / 1000.0;
+    uint64_t totalShown = 0;
+    for (const auto& cam : cams) {
+        totalShown += cam->shown;
+        std::cout << "cam " << cam->name << ": " << cam->shown << " frames, "
+                  << cv::format("%.1f", runSec > 0 ? cam->shown / runSec : 0.0) << " fps";
+        if (pcfg.latestFrame) std::cout << ", " << cam->latest.dropped() << " stale frames skipped";
+        std::cout << "\n";
+        if (cam->counters.frames > 0) {
+            std::ostringstream counts;
+            logCounters(counts, cam->counters);
+            std::cout << "  per frame:" << counts.str() << "\n";
+        }
+    }
+    if (droppedFrames() > 0) std::cout << "dropped: " << droppedFrames() << " frames\n";
+    if (numCams > 1)
+        std::cout << "all: " << totalShown << " frames, "
+                  << cv::format("%.1f", runSec > 0 ? totalShown / runSec : 0.0) << " fps\n";
+
     // Terminal restored automatically by TerminalRawGuard
-    cap.release();
-    cv::destroyAllWindows();
+    for (auto& cam : cams) {
+        // A frame left in the latest slot may still pin a driver buffer
+        FramePacket stale;
+        if (cam->latest.tryPop(stale)) releaseLease(stale);
+        cam->cap.release();
+        if (cam->v4l2) cam->v4l2->close();
+    }
+    if (dcfg.gui) cv::destroyAllWindows();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,478 @@
+#include "marker_frontend.hpp"
+
+#include <opencv2/core/ocl.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FRONTEND_X86 1
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define FRONTEND_NEON 1
+#endif
+
+// ---- Threshold kernels ----
+// A row kernel thresholds dst[begin, end) of one row for one window radius r,
+// where the whole window lies inside the image horizontally: the window sum
+// comes from the integral rows top/bot and area is constant along the row.
+// All kernels evaluate (src + delta) * area <= sum in float, so every
+// instruction set produces the same bits.
+typedef void (*ThresholdRowFn)(const uchar* src, const int* top, const int* bot, uchar* dst,
+                               int begin, int end, int r, float area, float delta);
+
+// The integral is kept modulo 2^32 (see integralWrapping); a window sum is
+// far below 2^31, so the unsigned difference is exact. The SIMD kernels get
+// the same result from wrapping 32-bit lane arithmetic.
+static inline int windowSum(const int* top, const int* bot, int x0, int x1) {
+    return (int)((unsigned)bot[x1] - (unsigned)bot[x0] - (unsigned)top[x1] + (unsigned)top[x0]);
+}
+
+static void thresholdRowScalar(const uchar* src, const int* top, const int* bot, uchar* dst,
+                               int begin, int end, int r, float area, float delta) {
+    for (int x = begin; x < end; ++x) {
+        int sum = windowSum(top, bot, x - r, x + r + 1);
+        dst[x] = ((float)src[x] + delta) * area <= (float)sum ? 255 : 0;
+    }
+}
+
+// Columns whose window is clipped by the left or right edge
+static void thresholdEdge(const uchar* src, const int* top, const int* bot, uchar* dst,
+                          int begin, int end, int r, int cols, int rowSpan, float delta) {
+    for (int x = begin; x < end; ++x) {
+        int x0 = std::max(0, x - r), x1 = std::min(cols, x + r + 1);
+        int sum = windowSum(top, bot, x0, x1);
+        float area = (float)(rowSpan * (x1 - x0));
+        dst[x] = ((float)src[x] + delta) * area <= (float)sum ? 255 : 0;
+    }
+}
+
+#ifdef FRONTEND_X86
+__attribute__((target("sse2")))
+static void thresholdRowSse2(const uchar* src, const int* top, const int* bot, uchar* dst,
+                             int begin, int end, int r, float area, float delta) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 varea = _mm_set1_ps(area), vdelta = _mm_set1_ps(delta);
+    int x = begin;
+    for (; x + 4 <= end; x += 4) {
+        __m128i sum = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(bot + x + r + 1)),
+                                    _mm_loadu_si128((const __m128i*)(bot + x - r)));
+        sum = _mm_sub_epi32(sum, _mm_loadu_si128((const __m128i*)(top + x + r + 1)));
+        sum = _mm_add_epi32(sum, _mm_loadu_si128((const __m128i*)(top + x - r)));
+        int p4;
+        std::memcpy(&p4, src + x, 4);
+        __m128i px = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(p4), zero), zero);
+        __m128 lhs = _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(px), vdelta), varea);
+        __m128i m = _mm_castps_si128(_mm_cmple_ps(lhs, _mm_cvtepi32_ps(sum)));
+        m = _mm_packs_epi16(_mm_packs_epi32(m, m), m);
+        int out = _mm_cvtsi128_si32(m);
+        std::memcpy(dst + x, &out, 4);
+    }
+    thresholdRowScalar(src, top, bot, dst, x, end, r, area, delta);
+}
+
+__attribute__((target("avx2")))
+static void thresholdRowAvx2(const uchar* src, const int* top, const int* bot, uchar* dst,
+                             int begin, int end, int r, float area, float delta) {
+    const __m256 varea = _mm256_set1_ps(area), vdelta = _mm256_set1_ps(delta);
+    int x = begin;
+    for (; x + 8 <= end; x += 8) {
+        __m256i sum = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(bot + x + r + 1)),
+                                       _mm256_loadu_si256((const __m256i*)(bot + x - r)));
+        sum = _mm256_sub_epi32(sum, _mm256_loadu_si256((const __m256i*)(top + x + r + 1)));
+        sum = _mm256_add_epi32(sum, _mm256_loadu_si256((const __m256i*)(top + x - r)));
+        __m256i px = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + x)));
+        __m256 lhs = _mm256_mul_ps(_mm256_add_ps(_mm256_cvtepi32_ps(px), vdelta), varea);
+        __m256i m = _mm256_castps_si256(_mm256_cmp_ps(lhs, _mm256_cvtepi32_ps(sum), _CMP_LE_OQ));
+        __m128i m16 = _mm_packs_epi32(_mm256_castsi256_si128(m), _mm256_extracti128_si256(m, 1));
+        _mm_storel_epi64((__m128i*)(dst + x), _mm_packs_epi16(m16, m16));
+    }
+    thresholdRowSse2(src, top, bot, dst, x, end, r, area, delta);
+}
+#endif
+
+#ifdef FRONTEND_NEON
+static void thresholdRowNeon(const uchar* src, const int* top, const int* bot, uchar* dst,
+                             int begin, int end, int r, float area, float delta) {
+    const float32x4_t varea = vdupq_n_f32(area), vdelta = vdupq_n_f32(delta);
+    int x = begin;
+    for (; x + 8 <= end; x += 8) {
+        uint32x4_t m[2];
+        uint16x8_t px = vmovl_u8(vld1_u8(src + x));
+        for (int h = 0; h < 2; ++h) {
+            const int xs = x + 4 * h;
+            int32x4_t sum = vsubq_s32(vld1q_s32(bot + xs + r + 1), vld1q_s32(bot + xs - r));
+            sum = vaddq_s32(vsubq_s32(sum, vld1q_s32(top + xs + r + 1)), vld1q_s32(top + xs - r));
+            uint32x4_t p = vmovl_u16(h == 0 ? vget_low_u16(px) : vget_high_u16(px));
+            float32x4_t lhs = vmulq_f32(vaddq_f32(vcvtq_f32_u32(p), vdelta), varea);
+            m[h] = vcleq_f32(lhs, vcvtq_f32_s32(sum));
+        }
+        vst1_u8(dst + x, vmovn_u16(vcombine_u16(vmovn_u32(m[0]), vmovn_u32(m[1]))));
+    }
+    thresholdRowScalar(src, top, bot, dst, x, end, r, area, delta);
+}
+#endif
+
+struct ThresholdKernel {
+    ThresholdRowFn fn;
+    const char* name;
+};
+
+// Chosen once per process. ARUCO_THRESHOLD_ISA=scalar forces the portable path.
+static ThresholdKernel pickKernel() {
+    const char* force = std::getenv("ARUCO_THRESHOLD_ISA");
+    if (force && std::strcmp(force, "scalar") == 0) return {thresholdRowScalar, "scalar"};
+#if defined(FRONTEND_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return {thresholdRowAvx2, "avx2"};
+    if (__builtin_cpu_supports("sse2")) return {thresholdRowSse2, "sse2"};
+#elif defined(FRONTEND_NEON)
+    return {thresholdRowNeon, "neon"}; // baseline on aarch64 and -mfpu=neon builds
+#endif
+    return {thresholdRowScalar, "scalar"};
+}
+
+static const ThresholdKernel& thresholdKernel() {
+    static const ThresholdKernel k = pickKernel();
+    return k;
+}
+
+const char* thresholdIsa() {
+    return thresholdKernel().name;
+}
+
+// cv::integral into CV_32S overflows once 255 * width * height passes
+// INT32_MAX, just above 3840x2160. Summing in uint32 instead wraps, which only
+// the window differences ever see, so any frame size works.
+static void integralWrapping(const cv::Mat& gray, cv::Mat& integral) {
+    integral.create(gray.rows + 1, gray.cols + 1, CV_32S);
+    uint32_t* prev = integral.ptr<uint32_t>(0);
+    std::fill(prev, prev + gray.cols + 1, 0u);
+    for (int y = 0; y < gray.rows; ++y) {
+        const uchar* src = gray.ptr<uchar>(y);
+        uint32_t* row = integral.ptr<uint32_t>(y + 1);
+        uint32_t run = 0;
+        row[0] = 0;
+        for (int x = 0; x < gray.cols; ++x) {
+            run += src[x];
+            row[x + 1] = prev[x + 1] + run;
+        }
+        prev = row;
+    }
+}
+
+void adaptiveThresholdMulti(const cv::Mat& gray, const std::vector<int>& winSizes, double delta,
+                            cv::Mat& integral, std::vector<cv::Mat>& out) {
+    CV_Assert(gray.type() == CV_8UC1);
+    integralWrapping(gray, integral);
+    out.resize(winSizes.size());
+    for (cv::Mat& m : out) m.create(gray.size(), CV_8UC1);
+
+    const ThresholdRowFn fn = thresholdKernel().fn;
+    const int rows = gray.rows, cols = gray.cols;
+    const float d = (float)cvFloor(delta);
+    // Row-major over the frame with every window size per row: the source row
+    // and the integral rows it touches stay in cache across all scales.
+    for (int y = 0; y < rows; ++y) {
+        const uchar* src = gray.ptr<uchar>(y);
+        for (size_t s = 0; s < winSizes.size(); ++s) {
+            const int r = winSizes[s] / 2;
+            const int y0 = std::max(0, y - r), y1 = std::min(rows, y + r + 1);
+            const int* top = integral.ptr<int>(y0);
+            const int* bot = integral.ptr<int>(y1);
+            uchar* dst = out[s].ptr<uchar>(y);
+            const int begin = std::min(r, cols), end = std::max(begin, cols - r);
+            thresholdEdge(src, top, bot, dst, 0, begin, r, cols, y1 - y0, d);
+            if (end > begin) fn(src, top, bot, dst, begin, end, r, (float)((y1 - y0) * (2 * r + 1)), d);
+            thresholdEdge(src, top, bot, dst, end, cols, r, cols, y1 - y0, d);
+        }
+    }
+}
+// ---- End threshold kernels ----
+
+// ---- OpenCL threshold ----
+// Below this many pixels (tracker ROIs, coarse pyramid levels) the transfers
+// cost more than the device saves, so those stay on the CPU kernels
+static const size_t kMinOpenClPixels = 320 * 240;
+
+// Probing must not switch the T-API on for the rest of the process, so the
+// caller's setUseOpenCL choice is put back afterwards
+const std::string& openclDevice() {
+    static const std::string name = [] {
+        if (!cv::ocl::haveOpenCL()) return std::string();
+        const bool wasOn = cv::ocl::useOpenCL();
+        cv::ocl::setUseOpenCL(true);
+        std::string device;
+        if (cv::ocl::useOpenCL()) device = cv::ocl::Device::getDefault().name();
+        cv::ocl::setUseOpenCL(wasOn);
+        return device;
+    }();
+    return name;
+}
+
+// One upload, then every window size is thresholded on the device with the
+// CPU kernels' rule: (src + delta) * area <= sum in float over the window
+// clipped to the image, so both backends give the same binaries. The sums
+// are unnormalized box filters with a zero border, which is the clipped sum;
+// area is the same filter over a plane of ones, cached per frame size and
+// window list. Color
+// input also brings its gray plane back, which decoding samples from.
+void MarkerFrontEnd::thresholdOpenCL(const cv::Mat& image, double delta) {
+    image.copyTo(uImage_);
+    const cv::UMat* gray = &uImage_;
+    if (image.channels() != 1) {
+        cv::cvtColor(uImage_, uGray_, image.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+        gray = &uGray_;
+    }
+    if (areaWinSizes_ != winSizes_ || uOnes_.size() != gray->size()) {
+        areaWinSizes_ = winSizes_;
+        uOnes_ = cv::UMat::ones(gray->size(), CV_32FC1);
+        uAreas_.resize(winSizes_.size());
+        for (size_t s = 0; s < winSizes_.size(); ++s)
+            cv::boxFilter(uOnes_, uAreas_[s], CV_32F, cv::Size(winSizes_[s], winSizes_[s]), cv::Point(-1, -1),
+                          false, cv::BORDER_CONSTANT);
+    }
+    gray->convertTo(uShifted_, CV_32F, 1.0, (double)cvFloor(delta));
+    uBinaries_.resize(winSizes_.size());
+    for (size_t s = 0; s < winSizes_.size(); ++s) {
+        cv::boxFilter(*gray, uSum_, CV_32F, cv::Size(winSizes_[s], winSizes_[s]), cv::Point(-1, -1), false,
+                      cv::BORDER_CONSTANT);
+        cv::multiply(uShifted_, uAreas_[s], uLhs_);
+        cv::compare(uLhs_, uSum_, uBinaries_[s], cv::CMP_LE);
+    }
+    // Queue every kernel before the first read so the downloads overlap them
+    if (image.channels() != 1) uGray_.copyTo(gray_);
+    binaries_.resize(uBinaries_.size());
+    for (size_t s = 0; s < uBinaries_.size(); ++s) uBinaries_[s].copyTo(binaries_[s]);
+}
+// ---- End OpenCL threshold ----
+
+static double msSince(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static void storeQuad(std::vector<std::vector<cv::Point2f>>& dst, size_t i, const cv::Point2f* pts) {
+    if (dst.size() <= i) dst.resize(i + 1);
+    dst[i].assign(pts, pts + 4);
+}
+
+// Same filters as aruco's contour stage: perimeter range, convex 4-gon,
+// minimum side length and distance to the image border.
+void MarkerFrontEnd::findCandidates(const cv::Mat& gray, const cv::aruco::DetectorParameters& p) {
+    const int maxDim = std::max(gray.cols, gray.rows);
+    const size_t minPerimeter = (size_t)(p.minMarkerPerimeterRate * maxDim);
+    const size_t maxPerimeter = (size_t)(p.maxMarkerPerimeterRate * maxDim);
+    const int border = p.minDistanceToBorder;
+
+    candidates_.clear();
+    for (cv::Mat& bin : binaries_) {
+        cv::findContours(bin, contours_, cv::RETR_LIST, cv::CHAIN_APPROX_NONE);
+        for (const auto& contour : contours_) {
+            if (contour.size() < minPerimeter || contour.size() > maxPerimeter) continue;
+            cv::approxPolyDP(contour, approx_, (double)contour.size() * p.polygonalApproxAccuracyRate, true);
+            if (approx_.size() != 4 || !cv::isContourConvex(approx_)) continue;
+
+            double minSideSq = (double)maxDim * maxDim;
+            bool nearBorder = false;
+            for (int j = 0; j < 4; ++j) {
+                const cv::Point d = approx_[j] - approx_[(j + 1) % 4];
+                minSideSq = std::min(minSideSq, (double)d.dot(d));
+                const cv::Point& c = approx_[j];
+                if (c.x < border || c.y < border || c.x > gray.cols - 1 - border || c.y > gray.rows - 1 - border)
+                    nearBorder = true;
+            }
+            const double minSide = (double)contour.size() * p.minCornerDistanceRate;
+            if (nearBorder || minSideSq < minSide * minSide) continue;
+
+            Candidate cand;
+            for (int j = 0; j < 4; ++j) cand.pts[j] = cv::Point2f((float)approx_[j].x, (float)approx_[j].y);
+            // Consistent winding so decoded rotations match aruco's
+            const cv::Point2f a = cand.pts[1] - cand.pts[0], b = cand.pts[2] - cand.pts[0];
+            if (a.x * b.y - a.y * b.x < 0) std::swap(cand.pts[1], cand.pts[3]);
+            cand.perimeter = contour.size();
+            candidates_.push_back(cand);
+        }
+    }
+
+    // Every window size finds the same marker again, and each marker border
+    // yields an inner and an outer contour: keep the largest of a close group.
+    keep_.assign(candidates_.size(), 1);
+    for (size_t i = 0; i < candidates_.size(); ++i) {
+        for (size_t j = i + 1; j < candidates_.size() && keep_[i]; ++j) {
+            if (!keep_[j]) continue;
+            const Candidate& a = candidates_[i];
+            const Candidate& b = candidates_[j];
+            const double minDist = (double)std::min(a.perimeter, b.perimeter) * p.minMarkerDistanceRate;
+            for (int rot = 0; rot < 4; ++rot) {
+                double distSq = 0;
+                for (int k = 0; k < 4; ++k) {
+                    const cv::Point2f d = a.pts[(k + rot) % 4] - b.pts[k];
+                    distSq += d.dot(d);
+                }
+                if (distSq / 4.0 < minDist * minDist) {
+                    keep_[a.perimeter >= b.perimeter ? j : i] = 0;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// Sample the cells of a markerSize grid (plus border) from one candidate
+// into bits_. False when the border ring has too many white cells.
+bool MarkerFrontEnd::sampleBits(const cv::Mat& gray, int markerSize, const cv::aruco::DetectorParameters& p,
+                                const Candidate& c) {
+    const int border = p.markerBorderBits;
+    const int cells = markerSize + 2 * border, cellSize = p.perspectiveRemovePixelPerCell;
+    const float side = (float)(cells * cellSize - 1);
+    const cv::Point2f dst[4] = {cv::Point2f(0, 0), cv::Point2f(side, 0), cv::Point2f(side, side), cv::Point2f(0, side)};
+    cv::warpPerspective(gray, warped_, cv::getPerspectiveTransform(c.pts, dst),
+                        cv::Size(cells * cellSize, cells * cellSize), cv::INTER_NEAREST);
+
+    bits_.create(cells, cells, CV_8UC1);
+    bits_.setTo(cv::Scalar(0));
+    cv::Scalar mean, stddev;
+    cv::meanStdDev(warped_(cv::Rect(cellSize / 2, cellSize / 2, warped_.cols - cellSize, warped_.rows - cellSize)),
+                   mean, stddev);
+    if (stddev[0] < p.minOtsuStdDev) {
+        // Flat patch: all cells take the same value
+        bits_.setTo(cv::Scalar(mean[0] > 127 ? 1 : 0));
+    } else {
+        cv::threshold(warped_, warped_, 125, 255, cv::THRESH_BINARY | cv::THRESH_OTSU);
+        const int margin = (int)(p.perspectiveRemoveIgnoredMarginPerCell * cellSize);
+        const int inner = cellSize - 2 * margin;
+        for (int y = 0; y < cells; ++y)
+            for (int x = 0; x < cells; ++x) {
+                const cv::Mat square = warped_(cv::Rect(x * cellSize + margin, y * cellSize + margin, inner, inner));
+                if ((size_t)cv::countNonZero(square) > square.total() / 2) bits_.at<uchar>(y, x) = 1;
+            }
+    }
+
+    // The border ring must be black (0); white-on-black markers only if allowed
+    auto borderCount = [&](uchar bit) {
+        int n = 0;
+        for (int y = 0; y < cells; ++y)
+            for (int x = 0; x < cells; ++x)
+                if ((y < border || y >= cells - border || x < border || x >= cells - border) &&
+                    bits_.at<uchar>(y, x) == bit)
+                    ++n;
+        return n;
+    };
+    int errors = borderCount(1);
+    if (p.detectInvertedMarker) {
+        int inverted = borderCount(0);
+        if (inverted < errors) {
+            for (int y = 0; y < cells; ++y)
+                for (int x = 0; x < cells; ++x) bits_.at<uchar>(y, x) ^= 1;
+            errors = inverted;
+        }
+    }
+    return errors <= (int)(markerSize * markerSize * p.maxErroneousBitsInBorderRate);
+}
+
+// Look the sampled bits up in each dictionary of group. On success id and
+// tag are set and the corners are rotated to the marker's origin.
+bool MarkerFrontEnd::identify(const GridGroup& group, const std::vector<DecodeDictionary>& dicts,
+                              const cv::aruco::DetectorParameters& p, Candidate& c, int& id, int& tag) {
+    const int border = p.markerBorderBits;
+    const cv::Mat onlyBits = bits_(cv::Rect(border, border, group.markerSize, group.markerSize));
+    for (size_t m : group.members) {
+        int rotation = 0;
+        const DecodeDictionary& d = dicts[m];
+        if (d.decoder ? !d.decoder->identify(onlyBits, id, rotation, p.errorCorrectionRate)
+                      : !d.dict->identify(onlyBits, id, rotation, p.errorCorrectionRate))
+            continue;
+        std::rotate(c.pts, c.pts + 4 - rotation, c.pts + 4);
+        tag = dicts[m].tag;
+        return true;
+    }
+    return false;
+}
+
+void MarkerFrontEnd::detect(const cv::Mat& image, const cv::Ptr<cv::aruco::Dictionary>& dict,
+                            const cv::Ptr<cv::aruco::DetectorParameters>& params,
+                            std::vector<std::vector<cv::Point2f>>& corners, std::vector<int>& ids,
+                            std::vector<std::vector<cv::Point2f>>& rejected) {
+    if (single_.empty() || single_[0].dict != dict) {
+        single_.resize(1);
+        single_[0].dict = dict;
+        single_[0].tag = 0;
+        single_[0].decoder = HammingDecoder::create(*dict);
+    }
+    detect(image, single_, params, corners, ids, singleTags_, rejected);
+}
+
+void MarkerFrontEnd::detect(const cv::Mat& image, const std::vector<DecodeDictionary>& dicts,
+                            const cv::Ptr<cv::aruco::DetectorParameters>& params,
+                            std::vector<std::vector<cv::Point2f>>& corners, std::vector<int>& ids,
+                            std::vector<int>& tags, std::vector<std::vector<cv::Point2f>>& rejected) {
+    const cv::aruco::DetectorParameters& p = *params;
+    auto t0 = std::chrono::steady_clock::now();
+    winSizes_.clear();
+    const int step = std::max(1, p.adaptiveThreshWinSizeStep);
+    for (int w = std::max(3, p.adaptiveThreshWinSizeMin); w <= p.adaptiveThreshWinSizeMax; w += step)
+        winSizes_.push_back(w | 1);
+    const cv::Mat* gray = &image;
+    if (openCL_ && image.total() >= kMinOpenClPixels) {
+        thresholdOpenCL(image, p.adaptiveThreshConstant);
+        if (image.channels() != 1) gray = &gray_;
+    } else {
+        if (image.channels() != 1) {
+            cv::cvtColor(image, gray_, image.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+            gray = &gray_;
+        }
+        adaptiveThresholdMulti(*gray, winSizes_, p.adaptiveThreshConstant, integral_, binaries_);
+    }
+    timings_.thresholdMs += msSince(t0);
+
+    t0 = std::chrono::steady_clock::now();
+    findCandidates(*gray, p);
+    timings_.contoursMs += msSince(t0);
+
+    t0 = std::chrono::steady_clock::now();
+    groups_.clear();
+    for (size_t m = 0; m < dicts.size(); ++m) {
+        const int markerSize = dicts[m].dict->markerSize;
+        size_t g = 0;
+        while (g < groups_.size() && groups_[g].markerSize != markerSize) ++g;
+        if (g == groups_.size()) {
+            groups_.push_back(GridGroup());
+            groups_[g].markerSize = markerSize;
+        }
+        groups_[g].members.push_back(m);
+    }
+
+    ids.clear();
+    tags.clear();
+    size_t nCorners = 0, nRejected = 0;
+    for (size_t i = 0; i < candidates_.size(); ++i) {
+        if (!keep_[i]) continue;
+        Candidate& c = candidates_[i];
+        int id = -1, tag = 0;
+        bool found = false;
+        ++timings_.candidates;
+        for (size_t g = 0; g < groups_.size() && !found; ++g) {
+            ++timings_.decodeAttempts;
+            found = sampleBits(*gray, groups_[g].markerSize, p, c) && identify(groups_[g], dicts, p, c, id, tag);
+        }
+        if (found) {
+            ids.push_back(id);
+            tags.push_back(tag);
+            storeQuad(corners, nCorners++, c.pts);
+        } else {
+            storeQuad(rejected, nRejected++, c.pts);
+        }
+    }
+    corners.resize(nCorners);
+    rejected.resize(nRejected);
+    if (p.cornerRefinementMethod == cv::aruco::CORNER_REFINE_SUBPIX) {
+        const cv::TermCriteria crit(cv::TermCriteria::MAX_ITER | cv::TermCriteria::EPS,
+                                    p.cornerRefinementMaxIterations, p.cornerRefinementMinAccuracy);
+        for (auto& quad : corners)
+            cv::cornerSubPix(*gray, quad, cv::Size(p.cornerRefinementWinSize, p.cornerRefinementWinSize),
+                             cv::Size(-1, -1), crit);
+    }
+    timings_.decodeMs += msSince(t0);
+}
@@ -0,0 +1,110 @@
+// In-tree replacement for the candidate stage of cv::aruco::detectMarkers:
+// one vectorized pass computes the adaptive threshold for every configured
+// window size from a single integral image, then contours are filtered into
+// quads and decoded against the aruco dictionary.
+
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/aruco.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "hamming_decoder.hpp"
+
+// Time spent in each stage and work done, accumulated over detect() calls
+// until reset
+struct FrontEndTimings {
+    double thresholdMs = 0.0;
+    double contoursMs = 0.0;
+    double decodeMs = 0.0;
+    size_t candidates = 0;     // quads left after the contour filters and de-duplication
+    size_t decodeAttempts = 0; // bit samplings, one per candidate and grid size tried
+    void reset() {
+        thresholdMs = contoursMs = decodeMs = 0.0;
+        candidates = decodeAttempts = 0;
+    }
+};
+
+// Threshold image (8-bit gray, may be a ROI view) at each odd window size into
+// out[i]: 255 where the pixel is at least floor(delta) below its local mean,
+// matching cv::adaptiveThreshold(MEAN_C, THRESH_BINARY_INV). The mean is taken
+// over the window clipped to the image. integral is caller-owned scratch.
+void adaptiveThresholdMulti(const cv::Mat& gray, const std::vector<int>& winSizes, double delta,
+                            cv::Mat& integral, std::vector<cv::Mat>& out);
+
+// Instruction set picked at startup for the threshold kernel: avx2, sse2, neon or scalar
+const char* thresholdIsa();
+
+// Name of the OpenCL device the T-API would run on, empty when there is none
+// (no runtime, no device, or OpenCV built without OpenCL). Probed once;
+// cv::ocl::useOpenCL() is left as the caller had it.
+const std::string& openclDevice();
+
+// One dictionary to decode against; tag is reported with every marker it decodes
+struct DecodeDictionary {
+    cv::Ptr<cv::aruco::Dictionary> dict;
+    int tag;
+    std::shared_ptr<const HammingDecoder> decoder; // table lookup for dict; null = dict->identify
+};
+
+// Not thread-safe: give each worker its own instance, which keeps its buffers.
+class MarkerFrontEnd {
+public:
+    // Same inputs and outputs as cv::aruco::detectMarkers without camera parameters
+    void detect(const cv::Mat& image, const cv::Ptr<cv::aruco::Dictionary>& dict,
+                const cv::Ptr<cv::aruco::DetectorParameters>& params,
+                std::vector<std::vector<cv::Point2f>>& corners, std::vector<int>& ids,
+                std::vector<std::vector<cv::Point2f>>& rejected);
+
+    // Candidates are found once and decoded against every dictionary. Those
+    // sharing a bit-grid size share one sampling of the candidate; the first
+    // dictionary in the list that accepts the bits wins. tags[i] is the tag
+    // of the dictionary that decoded ids[i].
+    void detect(const cv::Mat& image, const std::vector<DecodeDictionary>& dicts,
+                const cv::Ptr<cv::aruco::DetectorParameters>& params,
+                std::vector<std::vector<cv::Point2f>>& corners, std::vector<int>& ids,
+                std::vector<int>& tags, std::vector<std::vector<cv::Point2f>>& rejected);
+
+    FrontEndTimings& timings() { return timings_; }
+
+    // Gray conversion and thresholding on the OpenCL device through cv::UMat;
+    // only the binary images come back for contours and decoding. Ignored
+    // when openclDevice() is empty.
+    void setOpenCL(bool on) { openCL_ = on && !openclDevice().empty(); }
+
+private:
+    struct Candidate {
+        cv::Point2f pts[4];
+        size_t perimeter; // contour length in pixels
+    };
+
+    // Dictionaries of one markerSize, as indices into the detect() list
+    struct GridGroup {
+        int markerSize;
+        std::vector<size_t> members;
+    };
+
+    void thresholdOpenCL(const cv::Mat& image, double delta);
+    void findCandidates(const cv::Mat& gray, const cv::aruco::DetectorParameters& p);
+    bool sampleBits(const cv::Mat& gray, int markerSize, const cv::aruco::DetectorParameters& p,
+                    const Candidate& c);
+    bool identify(const GridGroup& group, const std::vector<DecodeDictionary>& dicts,
+                  const cv::aruco::DetectorParameters& p, Candidate& c, int& id, int& tag);
+
+    cv::Mat gray_, integral_, warped_, bits_;
+    std::vector<int> winSizes_, areaWinSizes_; // areaWinSizes_: what uAreas_ was built for
+    std::vector<cv::Mat> binaries_;
+    cv::UMat uImage_, uGray_, uShifted_, uSum_, uLhs_, uOnes_;
+    std::vector<cv::UMat> uAreas_, uBinaries_;
+    bool openCL_ = false;
+    std::vector<std::vector<cv::Point>> contours_;
+    std::vector<cv::Point> approx_;
+    std::vector<Candidate> candidates_;
+    std::vector<char> keep_;
+    std::vector<GridGroup> groups_;
+    std::vector<DecodeDictionary> single_;
+    std::vector<int> singleTags_;
+    FrontEndTimings timings_;
+};
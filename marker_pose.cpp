@@ -0,0 +1,147 @@
+#include "marker_pose.hpp"
+
+#include <cmath>
+
+// Frames a marker may go unseen before its track is dropped
+static const uint64_t kMaxTrackGap = 5;
+// Alpha-beta gains: position follows measurements closely, velocity slowly
+static const float kAlpha = 0.6f;
+static const float kBeta = 0.1f;
+
+bool CameraIntrinsics::load(const std::string& path, std::string& error) {
+    try {
+        cv::FileStorage fs(path, cv::FileStorage::READ);
+        if (!fs.isOpened()) {
+            error = "无法打开标定文件 " + path;
+            return false;
+        }
+        cv::Mat k, d;
+        fs["camera_matrix"] >> k;
+        fs["distortion_coefficients"] >> d;
+        if (k.rows != 3 || k.cols != 3) {
+            error = "标定文件 " + path + " 缺少 3x3 camera_matrix";
+            return false;
+        }
+        k.convertTo(cameraMatrix, CV_64F);
+        if (!d.empty()) d.convertTo(distCoeffs, CV_64F);
+        else distCoeffs.release();
+    } catch (const cv::Exception& e) {
+        error = "无法解析标定文件 " + path + ": " + e.what();
+        return false;
+    }
+    return true;
+}
+
+// trace(Ra^T Rb) = 1 + 2 cos(angle between the rotations): larger is closer
+static double rotationAgreement(const cv::Vec3d& a, const cv::Vec3d& b) {
+    cv::Matx33d ra, rb;
+    cv::Rodrigues(a, ra);
+    cv::Rodrigues(b, rb);
+    double s = 0.0;
+    for (int i = 0; i < 9; ++i) s += ra.val[i] * rb.val[i];
+    return s;
+}
+
+PoseEstimator::PoseEstimator(const CameraIntrinsics& intrinsics, double markerLength) : intrinsics_(intrinsics) {
+    const float h = (float)(markerLength / 2);
+    objectPoints_ = {cv::Point3f(-h, h, 0), cv::Point3f(h, h, 0), cv::Point3f(h, -h, 0), cv::Point3f(-h, -h, 0)};
+}
+
+// Predict each corner from its velocity and blend in the measurement. A jump
+// larger than a quarter of the marker side restarts the filter instead of
+// dragging the corners across; the return value says whether it restarted.
+bool PoseEstimator::filterCorners(Track& t, const std::vector<cv::Point2f>& meas, uint64_t seq, bool fresh) {
+    const float dt = fresh ? 1.0f : (float)(seq - t.lastSeq);
+    t.lastSeq = seq;
+    cv::Point2f residual[4];
+    if (!fresh) {
+        const cv::Point2f side = meas[1] - meas[0];
+        const float limit = 0.25f * std::sqrt(side.dot(side)) + 2.0f;
+        for (int j = 0; j < 4 && !fresh; ++j) {
+            residual[j] = meas[j] - (t.pos[j] + t.vel[j] * dt);
+            fresh = residual[j].dot(residual[j]) > limit * limit;
+        }
+    }
+    for (int j = 0; j < 4; ++j) {
+        if (fresh) {
+            t.pos[j] = meas[j];
+            t.vel[j] = cv::Point2f(0, 0);
+        } else {
+            t.pos[j] = t.pos[j] + t.vel[j] * dt + residual[j] * kAlpha;
+            t.vel[j] = t.vel[j] + residual[j] * (kBeta / dt);
+        }
+    }
+    return fresh;
+}
+
+void PoseEstimator::estimate(uint64_t seq, const std::vector<int>& dicts, const std::vector<int>& ids,
+                             const std::vector<std::vector<cv::Point2f>>& corners, std::vector<MarkerPose>& out) {
+    out.clear();
+    const size_t n = ids.size();
+    if (n == 0) return;
+
+    // Filter every marker, then undistort all corners in one call: the
+    // solver below works on normalized coordinates with an identity camera.
+    std::vector<Track*> tracks(n, nullptr);
+    rawPts_.resize(4 * n);
+    out.resize(n);
+    for (size_t k = 0; k < n; ++k) {
+        MarkerPose& mp = out[k];
+        mp.dict = dicts[k];
+        mp.id = ids[k];
+        mp.tracked = false;
+        const uint64_t key = ((uint64_t)(uint32_t)dicts[k] << 32) | (uint32_t)ids[k];
+        auto it = tracks_.find(key);
+        if (it != tracks_.end() && it->second.lastSeq >= seq) {
+            // Same ID twice in one frame, or a frame a worker finished late:
+            // solve untracked rather than step the track backwards
+            for (int j = 0; j < 4; ++j) mp.pts[j] = corners[k][j];
+        } else {
+            const bool stale = it == tracks_.end() || seq - it->second.lastSeq > kMaxTrackGap;
+            Track& t = tracks_[key];
+            // A jump restarts the track too: treat it like a new marker
+            const bool fresh = filterCorners(t, corners[k], seq, stale);
+            tracks[k] = &t;
+            mp.tracked = !fresh;
+            for (int j = 0; j < 4; ++j) mp.pts[j] = t.pos[j];
+        }
+        for (int j = 0; j < 4; ++j) rawPts_[4 * k + j] = mp.pts[j];
+    }
+    cv::undistortPoints(rawPts_, normPts_, intrinsics_.cameraMatrix, intrinsics_.distCoeffs);
+
+    const cv::Mat identity = cv::Mat::eye(3, 3, CV_64F);
+    for (size_t k = 0; k < n; ++k) {
+        MarkerPose& mp = out[k];
+        const cv::Mat quad(4, 1, CV_32FC2, &normPts_[4 * k]);
+        Track* t = tracks[k];
+        // A square has two planar solutions that reproject almost equally on
+        // small or distant markers; a lone solve flips between them. With a
+        // track, keep the one with less rotation from the last frame.
+        const int solutions = cv::solvePnPGeneric(objectPoints_, quad, identity, cv::noArray(), rvecs_, tvecs_,
+                                                  false, cv::SOLVEPNP_IPPE_SQUARE);
+        if (solutions == 0) {
+            mp.rvec = mp.tvec = cv::Vec3d();
+            mp.tracked = false;
+            continue;
+        }
+        size_t best = 0;
+        if (mp.tracked && solutions > 1 &&
+            rotationAgreement(t->rvec, rvecs_[1]) > rotationAgreement(t->rvec, rvecs_[0]))
+            best = 1;
+        mp.rvec = rvecs_[best];
+        mp.tvec = tvecs_[best];
+        if (t) {
+            t->rvec = mp.rvec;
+            t->tvec = mp.tvec;
+        }
+    }
+
+    // Forget markers that left the scene
+    if (seq >= lastSweepSeq_ + 64) {
+        lastSweepSeq_ = seq;
+        for (auto it = tracks_.begin(); it != tracks_.end();) {
+            if (it->second.lastSeq < seq && seq - it->second.lastSeq > kMaxTrackGap) it = tracks_.erase(it);
+            else ++it;
+        }
+    }
+}
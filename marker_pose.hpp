@@ -0,0 +1,57 @@
+// Optional pose stage: per-marker corner smoothing and an IPPE_SQUARE solve,
+// with the previous pose of the same marker choosing between its two solutions.
+
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct CameraIntrinsics {
+    cv::Mat cameraMatrix; // 3x3
+    cv::Mat distCoeffs;   // may be empty
+
+    // OpenCV calibration file (YAML/XML/JSON) with camera_matrix and
+    // distortion_coefficients, as written by the calibration samples
+    bool load(const std::string& path, std::string& error);
+};
+
+struct MarkerPose {
+    int dict;
+    int id;
+    cv::Vec3d rvec, tvec;  // marker frame to camera frame; tvec in the unit of --marker-length (metres)
+    cv::Point2f pts[4];    // filtered corners the pose was solved from
+    bool tracked;          // the IPPE solution nearest the track's last pose was kept
+};
+
+// Not thread-safe and stateful: one instance per camera, fed with that
+// camera's frames. A frame that arrives late, at or below a marker's last
+// seq, is solved untracked and leaves that marker's track alone.
+class PoseEstimator {
+public:
+    PoseEstimator(const CameraIntrinsics& intrinsics, double markerLength);
+
+    void estimate(uint64_t seq, const std::vector<int>& dicts, const std::vector<int>& ids,
+                  const std::vector<std::vector<cv::Point2f>>& corners, std::vector<MarkerPose>& out);
+
+private:
+    // Alpha-beta state of one marker's corners plus its last pose
+    struct Track {
+        cv::Point2f pos[4];
+        cv::Point2f vel[4]; // px per frame
+        cv::Vec3d rvec, tvec;
+        uint64_t lastSeq;
+    };
+
+    // True when the track (re)started, so its old pose must not pick the solution
+    bool filterCorners(Track& t, const std::vector<cv::Point2f>& meas, uint64_t seq, bool fresh);
+
+    CameraIntrinsics intrinsics_;
+    std::vector<cv::Point3f> objectPoints_; // IPPE_SQUARE order
+    std::unordered_map<uint64_t, Track> tracks_;
+    uint64_t lastSweepSeq_ = 0;
+    std::vector<cv::Point2f> rawPts_, normPts_;
+    std::vector<cv::Vec3d> rvecs_, tvecs_; // IPPE_SQUARE's solutions, best reprojection first
+};
@@ -0,0 +1,171 @@
+#include "marker_vector.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+static const double kPtPerMm = 72.0 / 25.4;
+
+std::vector<CellRect> markerCellRects(const cv::aruco::Dictionary& dict, int id, int borderBits) {
+    const int ms = dict.markerSize;
+    const int n = ms + 2 * borderBits;
+    const cv::Mat bits = cv::aruco::Dictionary::getBitsFromByteList(dict.bytesList.rowRange(id, id + 1), ms);
+    // 1 = black: the border plus every 0 bit
+    std::vector<uchar> black(n * n, 1);
+    for (int y = 0; y < ms; ++y)
+        for (int x = 0; x < ms; ++x) black[(y + borderBits) * n + x + borderBits] = bits.at<uchar>(y, x) ? 0 : 1;
+
+    // Greedy cover: widest run from each free cell, then as many rows down
+    // as the whole run stays black
+    std::vector<CellRect> rects;
+    for (int y = 0; y < n; ++y) {
+        for (int x = 0; x < n; ++x) {
+            if (!black[y * n + x]) continue;
+            int w = 1;
+            while (x + w < n && black[y * n + x + w]) ++w;
+            int h = 1;
+            for (; y + h < n; ++h) {
+                int k = 0;
+                while (k < w && black[(y + h) * n + x + k]) ++k;
+                if (k < w) break;
+            }
+            for (int j = 0; j < h; ++j)
+                for (int k = 0; k < w; ++k) black[(y + j) * n + x + k] = 0;
+            rects.push_back({x, y, w, h});
+        }
+    }
+    return rects;
+}
+
+void VectorPage::addMarker(const std::vector<CellRect>& cells, int cellsPerSide, double x, double y, double sideMm) {
+    const double c = sideMm / cellsPerSide;
+    for (const CellRect& r : cells) fills.push_back(cv::Rect2d(x + r.x * c, y + r.y * c, r.w * c, r.h * c));
+}
+
+static std::string xmlEscape(const std::string& in) {
+    std::string out;
+    for (char ch : in) {
+        if (ch == '&') out += "&amp;";
+        else if (ch == '<') out += "&lt;";
+        else if (ch == '>') out += "&gt;";
+        else out += ch;
+    }
+    return out;
+}
+
+bool writeSvg(const std::string& path, const VectorPage& page) {
+    std::ostringstream os;
+    char buf[160];
+    std::snprintf(buf, sizeof(buf), "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%gmm\" height=\"%gmm\" "
+                  "viewBox=\"0 0 %g %g\">\n", page.widthMm, page.heightMm, page.widthMm, page.heightMm);
+    os << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n" << buf;
+    os << "<rect width=\"100%\" height=\"100%\" fill=\"#fff\"/>\n";
+    // One path for every cell so abutting rectangles render without seams
+    os << "<path fill=\"#000\" shape-rendering=\"crispEdges\" d=\"";
+    for (const cv::Rect2d& r : page.fills) {
+        std::snprintf(buf, sizeof(buf), "M%.4f %.4fh%.4fv%.4fh%.4fz", r.x, r.y, r.width, r.height, -r.width);
+        os << buf;
+    }
+    os << "\"/>\n";
+    if (!page.lines.empty()) {
+        os << "<path fill=\"none\" stroke=\"#000\" stroke-width=\"0.1\" d=\"";
+        for (const VectorPage::Line& l : page.lines) {
+            std::snprintf(buf, sizeof(buf), "M%.4f %.4fL%.4f %.4f", l.x0, l.y0, l.x1, l.y1);
+            os << buf;
+        }
+        os << "\"/>\n";
+    }
+    for (const VectorPage::Label& t : page.labels) {
+        std::snprintf(buf, sizeof(buf), "<text x=\"%.4f\" y=\"%.4f\" font-family=\"Helvetica,Arial,sans-serif\" "
+                      "font-size=\"%.4f\" fill=\"#606060\">", t.x, t.y, t.size);
+        os << buf << xmlEscape(t.text) << "</text>\n";
+    }
+    os << "</svg>\n";
+
+    std::ofstream out(path.c_str(), std::ios::binary);
+    out << os.str();
+    return (bool)out;
+}
+
+static std::string pdfString(const std::string& in) {
+    std::string out;
+    for (char ch : in) {
+        if (ch == '(' || ch == ')' || ch == '\\') out += '\\';
+        out += ch;
+    }
+    return out;
+}
+
+// Content stream in points, y up
+static std::string pdfContent(const VectorPage& page) {
+    const double h = page.heightMm;
+    std::ostringstream os;
+    char buf[160];
+    os << "0 g\n";
+    for (const cv::Rect2d& r : page.fills) {
+        std::snprintf(buf, sizeof(buf), "%.3f %.3f %.3f %.3f re\n", r.x * kPtPerMm, (h - r.y - r.height) * kPtPerMm,
+                      r.width * kPtPerMm, r.height * kPtPerMm);
+        os << buf;
+    }
+    if (!page.fills.empty()) os << "f\n"; // one fill for the whole set: no seams
+    if (!page.lines.empty()) {
+        std::snprintf(buf, sizeof(buf), "%.3f w 0 G\n", 0.1 * kPtPerMm);
+        os << buf;
+        for (const VectorPage::Line& l : page.lines) {
+            std::snprintf(buf, sizeof(buf), "%.3f %.3f m %.3f %.3f l\n", l.x0 * kPtPerMm, (h - l.y0) * kPtPerMm,
+                          l.x1 * kPtPerMm, (h - l.y1) * kPtPerMm);
+            os << buf;
+        }
+        os << "S\n";
+    }
+    for (const VectorPage::Label& t : page.labels) {
+        std::snprintf(buf, sizeof(buf), "BT 0.376 g /F1 %.3f Tf %.3f %.3f Td (", t.size * kPtPerMm, t.x * kPtPerMm,
+                      (h - t.y) * kPtPerMm);
+        os << buf << pdfString(t.text) << ") Tj ET\n";
+    }
+    return os.str();
+}
+
+// Objects: 1 catalog, 2 page tree, 3 font, then a page and its content
+// stream for every page
+bool writePdf(const std::string& path, const std::vector<VectorPage>& pages) {
+    std::ostringstream os;
+    std::vector<size_t> offsets;
+    auto begin = [&](size_t num) {
+        if (offsets.size() < num) offsets.resize(num);
+        offsets[num - 1] = (size_t)os.tellp();
+        os << num << " 0 obj\n";
+    };
+
+    os << "%PDF-1.4\n%\xE2\xE3\xCF\xD3\n";
+    begin(1);
+    os << "<< /Type /Catalog /Pages 2 0 R >>\nendobj\n";
+    begin(2);
+    os << "<< /Type /Pages /Count " << pages.size() << " /Kids [";
+    for (size_t i = 0; i < pages.size(); ++i) os << " " << 4 + 2 * i << " 0 R";
+    os << " ] >>\nendobj\n";
+    begin(3);
+    os << "<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica >>\nendobj\n";
+    char buf[160];
+    for (size_t i = 0; i < pages.size(); ++i) {
+        const size_t pageObj = 4 + 2 * i;
+        begin(pageObj);
+        std::snprintf(buf, sizeof(buf), "[0 0 %.3f %.3f]", pages[i].widthMm * kPtPerMm, pages[i].heightMm * kPtPerMm);
+        os << "<< /Type /Page /Parent 2 0 R /MediaBox " << buf << " /Resources << /Font << /F1 3 0 R >> >> /Contents "
+           << pageObj + 1 << " 0 R >>\nendobj\n";
+        const std::string content = pdfContent(pages[i]);
+        begin(pageObj + 1);
+        os << "<< /Length " << content.size() << " >>\nstream\n" << content << "endstream\nendobj\n";
+    }
+    const size_t xref = (size_t)os.tellp();
+    os << "xref\n0 " << offsets.size() + 1 << "\n0000000000 65535 f \n";
+    for (size_t off : offsets) {
+        std::snprintf(buf, sizeof(buf), "%010zu 00000 n \n", off);
+        os << buf;
+    }
+    os << "trailer\n<< /Size " << offsets.size() + 1 << " /Root 1 0 R >>\nstartxref\n" << xref << "\n%%EOF\n";
+
+    std::ofstream out(path.c_str(), std::ios::binary);
+    out << os.str();
+    return (bool)out;
+}
@@ -0,0 +1,37 @@
+// Vector marker export: the bit grid straight from Dictionary::bytesList,
+// black cells merged into rectangles, written as SVG or PDF. Output size and
+// time depend on the bit count, not on the printed size.
+
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/aruco.hpp>
+#include <string>
+#include <vector>
+
+// Black area of a marker in cell units, (0,0) at the top left of the border
+struct CellRect {
+    int x, y, w, h;
+};
+
+// Cells per side is markerSize + 2 * borderBits
+std::vector<CellRect> markerCellRects(const cv::aruco::Dictionary& dict, int id, int borderBits);
+
+// One page of black shapes, thin lines and gray labels, in millimetres with
+// the origin at the top left
+struct VectorPage {
+    struct Line { double x0, y0, x1, y1; };
+    struct Label { double x, y, size; std::string text; }; // y is the baseline
+
+    double widthMm = 0.0, heightMm = 0.0;
+    std::vector<cv::Rect2d> fills;
+    std::vector<Line> lines;  // stroked 0.1 mm, black
+    std::vector<Label> labels;
+
+    // Marker with its top-left border corner at (x, y) and sideMm per side
+    void addMarker(const std::vector<CellRect>& cells, int cellsPerSide, double x, double y, double sideMm);
+};
+
+bool writeSvg(const std::string& path, const VectorPage& page);
+// All pages in one document
+bool writePdf(const std::string& path, const std::vector<VectorPage>& pages);
@@ -0,0 +1,123 @@
+#include "result_publisher.hpp"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static int64_t monotonicNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+bool ResultPublisher::fail(const std::string& what) {
+    error_ = what + ": " + std::strerror(errno);
+    close();
+    return false;
+}
+
+bool ResultPublisher::open(const std::string& shmName, int slotCount, const std::string& udpTarget) {
+    close();
+    error_.clear();
+
+    if (!shmName.empty()) {
+        if (slotCount < 1) slotCount = 1;
+        const int fd = shm_open(shmName.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd < 0) return fail("无法创建共享内存 " + shmName);
+        shmName_ = shmName;
+        mapSize_ = sizeof(ShmRingHeader) + (size_t)slotCount * sizeof(ShmSlot);
+        if (ftruncate(fd, (off_t)mapSize_) != 0) {
+            ::close(fd);
+            return fail("无法设置共享内存大小 " + shmName);
+        }
+        void* p = mmap(nullptr, mapSize_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return fail("无法映射共享内存 " + shmName);
+        // A segment left by an earlier run is reset; magic goes in last so a
+        // reader that attaches meanwhile sees an invalid ring instead of stale slots
+        std::memset(p, 0, mapSize_);
+        ring_ = static_cast<ShmRingHeader*>(p);
+        slots_ = reinterpret_cast<ShmSlot*>(ring_ + 1);
+        ring_->version = kResultVersion;
+        ring_->slotCount = (uint32_t)slotCount;
+        ring_->slotSize = (uint32_t)sizeof(ShmSlot);
+        ring_->writeIndex.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        ring_->magic = kResultMagic;
+    }
+
+    if (!udpTarget.empty()) {
+        const size_t colon = udpTarget.rfind(':');
+        sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        const int port = colon == std::string::npos ? 0 : std::atoi(udpTarget.c_str() + colon + 1);
+        if (port <= 0 || port > 65535 ||
+            inet_pton(AF_INET, udpTarget.substr(0, colon).c_str(), &addr.sin_addr) != 1) {
+            error_ = "invalid UDP address " + udpTarget + " (expected ADDR:PORT)";
+            close();
+            return false;
+        }
+        addr.sin_port = htons((uint16_t)port);
+        udpFd_ = socket(AF_INET, SOCK_DGRAM, 0);
+        if (udpFd_ < 0) return fail("无法创建 UDP socket");
+        if (IN_MULTICAST(ntohl(addr.sin_addr.s_addr))) {
+            // Stay on the local network segment
+            const unsigned char ttl = 1;
+            setsockopt(udpFd_, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+        }
+        if (connect(udpFd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0)
+            return fail("无法连接 UDP 目标 " + udpTarget);
+    }
+
+    std::memset(&scratch_.header, 0, sizeof(scratch_.header));
+    scratch_.header.magic = kResultMagic;
+    scratch_.header.version = kResultVersion;
+    scratch_.header.headerSize = (uint16_t)sizeof(ResultRecordHeader);
+    return true;
+}
+
+void ResultPublisher::close() {
+    if (ring_) {
+        munmap(ring_, mapSize_);
+        // Readers that still have it mapped keep their view
+        shm_unlink(shmName_.c_str());
+    }
+    ring_ = nullptr;
+    slots_ = nullptr;
+    mapSize_ = 0;
+    shmName_.clear();
+    if (udpFd_ >= 0) ::close(udpFd_);
+    udpFd_ = -1;
+}
+
+// Single writer: never waits for readers, a slow reader just sees its slot's
+// sequence move on and retries with a newer index.
+void ResultPublisher::publish() {
+    ResultRecordHeader& h = scratch_.header;
+    h.publishNs = monotonicNs();
+    const size_t bytes = scratch_.usedSize();
+
+    if (ring_) {
+        const uint64_t i = ring_->writeIndex.load(std::memory_order_relaxed);
+        ShmSlot& slot = slots_[i % ring_->slotCount];
+        slot.sequence.store(2 * i + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(&slot.record, &scratch_, bytes);
+        slot.sequence.store(2 * i + 2, std::memory_order_release);
+        ring_->writeIndex.store(i + 1, std::memory_order_release);
+    }
+
+    if (udpFd_ >= 0) {
+        // Never block the render loop on the network; a full socket buffer drops
+        if (send(udpFd_, &scratch_, bytes, MSG_DONTWAIT) != (ssize_t)bytes) ++udpDropped_;
+    }
+}
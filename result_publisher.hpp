@@ -0,0 +1,126 @@
+// Binary detection results for other processes: fixed-size versioned records
+// in a shared-memory ring (single writer, any number of readers, no locks)
+// and optionally the same records as UDP datagrams.
+//
+// All fields are little-endian host order, naturally aligned; consumers map
+// the segment read-only and read records in place.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+static const uint32_t kResultMagic = 0x52555241; // "ARUR"
+static const uint16_t kResultVersion = 1;
+static const int kMaxRecordMarkers = 128;
+
+// ResultMarker::flags
+static const uint32_t kMarkerAllowed = 1u << 0; // on the ID allow-list
+static const uint32_t kMarkerHasPose = 1u << 1; // rvec/tvec valid
+
+struct ResultMarker {
+    int32_t dict;       // cv::aruco::PREDEFINED_DICTIONARY_NAME
+    int32_t id;
+    float corners[8];   // x0 y0 .. x3 y3, pixels, clockwise from the marker origin
+    float rvec[3];
+    float tvec[3];      // units of --marker-length
+    uint32_t flags;     // kMarker* bits
+    uint32_t reserved;
+};
+static_assert(sizeof(ResultMarker) == 72, "ResultMarker layout is part of the wire format");
+
+// ResultRecordHeader::flags
+static const uint32_t kRecordTruncated = 1u << 0; // more than kMaxRecordMarkers markers were detected
+
+struct ResultRecordHeader {
+    uint32_t magic;        // kResultMagic
+    uint16_t version;      // kResultVersion
+    uint16_t headerSize;   // sizeof(ResultRecordHeader)
+    uint32_t camera;       // index of the source on the command line
+    uint32_t markerCount;  // valid entries in markers[]
+    uint64_t seq;          // per-camera frame counter
+    int64_t sensorNs;      // driver/sensor timestamp, CLOCK_MONOTONIC; 0 if unknown
+    int64_t captureNs;     // frame handed to the pipeline, CLOCK_MONOTONIC
+    int64_t publishNs;     // record written, CLOCK_MONOTONIC
+    float detectMs;        // detector time for this frame
+    uint32_t flags;        // kRecord* bits
+};
+static_assert(sizeof(ResultRecordHeader) == 56, "ResultRecordHeader layout is part of the wire format");
+
+struct ResultRecord {
+    ResultRecordHeader header;
+    ResultMarker markers[kMaxRecordMarkers];
+
+    // Bytes actually used; UDP datagrams carry only these
+    size_t usedSize() const { return sizeof(header) + header.markerCount * sizeof(ResultMarker); }
+};
+
+// Shared-memory layout: ShmRingHeader, then slotCount ShmSlots. writeIndex
+// counts records ever published; record i lives in slot i % slotCount, whose
+// sequence is 2*i+1 while the writer fills it and 2*i+2 once it is complete.
+struct ShmRingHeader {
+    uint32_t magic;     // kResultMagic
+    uint16_t version;   // kResultVersion
+    uint16_t reserved;
+    uint32_t slotCount;
+    uint32_t slotSize;  // sizeof(ShmSlot)
+    std::atomic<uint64_t> writeIndex;
+    uint8_t pad[40];
+};
+static_assert(sizeof(ShmRingHeader) == 64, "ShmRingHeader layout is part of the shared-memory format");
+
+struct ShmSlot {
+    std::atomic<uint64_t> sequence;
+    uint64_t pad;
+    ResultRecord record;
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared-memory ring needs lock-free 64-bit atomics");
+
+// Reader side: copy record number index out of a mapped ring. False if it is
+// not published yet, or is being (or has been) overwritten by a newer one;
+// the newest record is writeIndex - 1.
+inline bool readShmRecord(const ShmRingHeader* ring, uint64_t index, ResultRecord& out) {
+    const ShmSlot* slots = reinterpret_cast<const ShmSlot*>(ring + 1);
+    const ShmSlot& slot = slots[index % ring->slotCount];
+    const uint64_t done = 2 * index + 2;
+    if (slot.sequence.load(std::memory_order_acquire) != done) return false;
+    out = slot.record;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.sequence.load(std::memory_order_relaxed) == done;
+}
+
+class ResultPublisher {
+public:
+    ResultPublisher() {}
+    ResultPublisher(const ResultPublisher&) = delete;
+    ResultPublisher& operator=(const ResultPublisher&) = delete;
+    ~ResultPublisher() { close(); }
+
+    // shmName like "/aruco_results" (empty = no ring); udpTarget "ADDR:PORT",
+    // a multicast group or unicast host (empty = no UDP).
+    bool open(const std::string& shmName, int slotCount, const std::string& udpTarget);
+    void close();
+    bool enabled() const { return ring_ != nullptr || udpFd_ >= 0; }
+
+    // Record to fill for the next publish(); its header is pre-set
+    ResultRecord& next() { return scratch_; }
+    void publish();
+
+    uint64_t udpDropped() const { return udpDropped_; }
+    const std::string& error() const { return error_; }
+
+private:
+    bool fail(const std::string& what);
+
+    std::string shmName_;
+    ShmRingHeader* ring_ = nullptr;
+    ShmSlot* slots_ = nullptr;
+    size_t mapSize_ = 0;
+    int udpFd_ = -1;
+    uint64_t udpDropped_ = 0;
+    ResultRecord scratch_;
+    std::string error_;
+};
@@ -0,0 +1,154 @@
+#include "stage_trace.hpp"
+#include "json_escape.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+void CounterTotals::add(const DetectCounters& c) {
+    ++frames;
+    candidates += c.candidates;
+    rejected += c.rejected;
+    decodeAttempts += c.decodeAttempts;
+    accepted += c.accepted;
+    wrong += c.wrong;
+    worst.candidates = std::max(worst.candidates, c.candidates);
+    worst.rejected = std::max(worst.rejected, c.rejected);
+    worst.decodeAttempts = std::max(worst.decodeAttempts, c.decodeAttempts);
+    worst.accepted = std::max(worst.accepted, c.accepted);
+    worst.wrong = std::max(worst.wrong, c.wrong);
+}
+
+std::atomic<bool> g_traceEnabled(false);
+
+struct TraceEvent {
+    const char* name;
+    double beginMs, endMs;
+    int camera;
+    uint64_t seq;
+    bool hasCounters;
+    DetectCounters counters;
+};
+
+// Written by its own thread only; read by traceWrite once that thread is done
+struct ThreadTrace {
+    std::string name;
+    int tid = 0;
+    std::vector<TraceEvent> ring;
+    uint64_t written = 0; // events ever recorded; the ring holds the last ring.size()
+};
+
+static std::mutex g_traceThreadsMutex; // registration and export only
+static std::vector<std::unique_ptr<ThreadTrace>> g_traceThreads; // outlive their threads
+static size_t g_traceCapacity = 0;
+static thread_local ThreadTrace* t_trace = nullptr;
+
+// Once per thread: the ring is allocated here, never while recording
+static ThreadTrace* threadTrace() {
+    if (t_trace) return t_trace;
+    std::lock_guard<std::mutex> lock(g_traceThreadsMutex);
+    std::unique_ptr<ThreadTrace> t(new ThreadTrace);
+    t->tid = (int)g_traceThreads.size() + 1;
+    t->name = "thread " + std::to_string(t->tid);
+    t->ring.resize(g_traceCapacity);
+    t_trace = t.get();
+    g_traceThreads.push_back(std::move(t));
+    return t_trace;
+}
+
+static void writeCounterArgs(std::ostream& os, const DetectCounters& c) {
+    os << "\"candidates\":" << c.candidates << ",\"rejected\":" << c.rejected
+       << ",\"decode_attempts\":" << c.decodeAttempts << ",\"accepted\":" << c.accepted
+       << ",\"wrong\":" << c.wrong;
+}
+
+void traceEnable(size_t eventsPerThread) {
+    {
+        std::lock_guard<std::mutex> lock(g_traceThreadsMutex);
+        g_traceCapacity = std::max<size_t>(1, eventsPerThread);
+    }
+    g_traceEnabled.store(true);
+}
+
+void traceThreadName(const std::string& name) {
+    if (!traceEnabled()) return;
+    threadTrace()->name = name;
+}
+
+void traceRecord(const char* name, double beginMs, double endMs, int camera, uint64_t seq,
+                 const DetectCounters* counters) {
+    if (!traceEnabled()) return;
+    ThreadTrace* t = threadTrace();
+    TraceEvent& e = t->ring[t->written % t->ring.size()];
+    e.name = name;
+    e.beginMs = beginMs;
+    e.endMs = endMs;
+    e.camera = camera;
+    e.seq = seq;
+    e.hasCounters = counters != nullptr;
+    if (counters) e.counters = *counters;
+    ++t->written;
+}
+
+bool traceWrite(const std::string& path, const std::vector<std::string>& cameras, std::string& error) {
+    std::lock_guard<std::mutex> lock(g_traceThreadsMutex);
+    std::ofstream os(path.c_str());
+    if (!os) {
+        error = "无法写入 " + path;
+        return false;
+    }
+    // Timestamps in microseconds from the first event kept
+    double originMs = -1.0;
+    for (const auto& t : g_traceThreads) {
+        const uint64_t kept = std::min<uint64_t>(t->written, t->ring.size());
+        for (uint64_t i = t->written - kept; i < t->written; ++i) {
+            const double b = t->ring[i % t->ring.size()].beginMs;
+            if (originMs < 0.0 || b < originMs) originMs = b;
+        }
+    }
+    auto cameraName = [&](int c) {
+        return jsonEscape(c < (int)cameras.size() ? cameras[c] : std::to_string(c));
+    };
+    char ts[64];
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto& t : g_traceThreads) {
+        os << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t->tid
+           << ",\"args\":{\"name\":\"" << jsonEscape(t->name) << "\"}}";
+        first = false;
+        const uint64_t kept = std::min<uint64_t>(t->written, t->ring.size());
+        for (uint64_t i = t->written - kept; i < t->written; ++i) {
+            const TraceEvent& e = t->ring[i % t->ring.size()];
+            std::snprintf(ts, sizeof(ts), "\"ts\":%.3f,\"dur\":%.3f", (e.beginMs - originMs) * 1000.0,
+                          (e.endMs - e.beginMs) * 1000.0);
+            os << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\"," << ts << ",\"pid\":1,\"tid\":" << t->tid;
+            if (e.camera >= 0) {
+                os << ",\"args\":{\"camera\":\"" << cameraName(e.camera) << "\",\"seq\":" << e.seq;
+                if (e.hasCounters) {
+                    os << ",";
+                    writeCounterArgs(os, e.counters);
+                }
+                os << "}";
+            }
+            os << "}";
+            // The same figures as a counter track per camera, plotted over time
+            if (e.hasCounters && e.camera >= 0) {
+                std::snprintf(ts, sizeof(ts), "\"ts\":%.3f", (e.endMs - originMs) * 1000.0);
+                os << ",\n{\"name\":\"detect [" << cameraName(e.camera) << "]\",\"ph\":\"C\"," << ts
+                   << ",\"pid\":1,\"args\":{";
+                writeCounterArgs(os, e.counters);
+                os << "}}";
+            }
+        }
+    }
+    os << "\n]}\n";
+    os.close();
+    if (!os) {
+        error = "无法写入 " + path;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,74 @@
+// Always-on detection counters per camera, and optional scope timings written
+// as a Chrome trace (chrome://tracing, ui.perfetto.dev) with --trace FILE.
+// Each thread records into its own fixed ring: no locks and no allocation on
+// the recording path, and one relaxed load per scope while tracing is off.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "aruco_detector.hpp"
+
+// Sums over a camera's frames, plus the worst single frame of each counter
+struct CounterTotals {
+    uint64_t frames = 0;
+    uint64_t candidates = 0;
+    uint64_t rejected = 0;
+    uint64_t decodeAttempts = 0;
+    uint64_t accepted = 0;
+    uint64_t wrong = 0;
+    DetectCounters worst;
+
+    void add(const DetectCounters& c);
+};
+
+extern std::atomic<bool> g_traceEnabled;
+
+inline bool traceEnabled() { return g_traceEnabled.load(std::memory_order_relaxed); }
+
+// Same clock and unit as main's nowMs()
+inline double traceNowMs() {
+    auto t = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration<double, std::milli>(t).count();
+}
+
+// Start recording; every thread keeps its last eventsPerThread scopes
+void traceEnable(size_t eventsPerThread = 1 << 16);
+
+// Label for the calling thread's track, e.g. "capture 0"; call before its
+// first scope. Unnamed threads are numbered.
+void traceThreadName(const std::string& name);
+
+// One finished scope on the calling thread. name must outlive the trace (a
+// literal); times are steady_clock milliseconds as nowMs() returns them.
+// camera < 0 leaves the camera and seq out of the event.
+void traceRecord(const char* name, double beginMs, double endMs, int camera = -1, uint64_t seq = 0,
+                 const DetectCounters* counters = nullptr);
+
+// Chrome trace JSON with every ring's events, plus a counter track per camera
+// from the detect scopes; cameras[i] labels camera i. Only once the recording
+// threads have stopped.
+bool traceWrite(const std::string& path, const std::vector<std::string>& cameras, std::string& error);
+
+// Records from construction to destruction when tracing is on
+class TraceScope {
+public:
+    explicit TraceScope(const char* name, int camera = -1, uint64_t seq = 0)
+        : name_(name), camera_(camera), seq_(seq), beginMs_(traceEnabled() ? traceNowMs() : -1.0) {}
+    ~TraceScope() {
+        if (beginMs_ >= 0.0) traceRecord(name_, beginMs_, traceNowMs(), camera_, seq_);
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name_;
+    int camera_;
+    uint64_t seq_;
+    double beginMs_; // negative when tracing was off at construction
+};
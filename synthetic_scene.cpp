@@ -0,0 +1,123 @@
+#include "synthetic_scene.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+SyntheticScene::SyntheticScene(const SceneConfig& cfg, const cv::Ptr<cv::aruco::Dictionary>& dict, int dictId)
+    : cfg_(cfg), dictId_(dictId) {
+    // Same proportions as the generator's printed markers (margin = side / 5
+    // for sides of 150 px and up): a white quiet zone of a seventh of the
+    // template on each side
+    quietPx_ = cfg_.templatePx / 7;
+    const int side = cfg_.templatePx - 2 * quietPx_;
+    const int count = std::max(1, std::min(cfg_.bankSize, dict->bytesList.rows));
+    cv::Mat marker;
+    for (int id = 0; id < count; ++id) {
+        cv::Mat t(cfg_.templatePx, cfg_.templatePx, CV_8UC1, cv::Scalar(255));
+        cv::aruco::drawMarker(dict, id, side, marker, 1);
+        marker.copyTo(t(cv::Rect(quietPx_, quietPx_, side, side)));
+        bank_.push_back(t);
+    }
+}
+
+void SyntheticScene::render(uint64_t n, cv::Mat& out, std::vector<SceneMarker>& truth) {
+    cv::RNG rng(cfg_.seed * 0x9E3779B97F4A7C15ull + n + 1);
+    const cv::Size size = cfg_.size;
+    out.create(size, CV_8UC1);
+    out.setTo(cv::Scalar(rng.uniform(90, 170)));
+    truth.clear();
+
+    // One marker per grid cell, so markers never overlap
+    const int markerCount = std::max(0, cfg_.markers);
+    const int cols = std::max(1, (int)std::ceil(std::sqrt((double)markerCount * size.width / size.height)));
+    const int rows = std::max(1, (markerCount + cols - 1) / cols);
+    const double cellW = (double)size.width / cols, cellH = (double)size.height / rows;
+    const double markerFrac = (double)(cfg_.templatePx - 2 * quietPx_) / cfg_.templatePx;
+    const float T = (float)cfg_.templatePx, q = (float)quietPx_;
+    const std::vector<cv::Point2f> tplOuter = {{0, 0}, {T, 0}, {T, T}, {0, T}};
+    const std::vector<cv::Point2f> tplMarker = {{q, q}, {T - q, q}, {T - q, T - q}, {q, T - q}};
+    std::vector<cv::Point2f> dst(4), markerDst(4);
+
+    for (int k = 0; k < markerCount; ++k) {
+        const int id = rng.uniform(0, (int)bank_.size());
+        // The rotated template corners, jitter included, reach 1.65 half sides
+        // from the centre and have to stay inside the cell
+        const double fitSide = std::min(cellW, cellH) / 1.65 * markerFrac;
+        const double side = std::min(fitSide, rng.uniform(cfg_.minSidePx, cfg_.maxSidePx));
+        const double half = 0.5 * side / markerFrac; // template half side on the frame
+        const double reach = half * 1.65;
+        const double cx = (k % cols) * cellW + cellW / 2 + rng.uniform(-1.0, 1.0) * std::max(0.0, cellW / 2 - reach);
+        const double cy = (k / cols) * cellH + cellH / 2 + rng.uniform(-1.0, 1.0) * std::max(0.0, cellH / 2 - reach);
+        const double angle = rng.uniform(0.0, 2 * CV_PI);
+        const double c = std::cos(angle), s = std::sin(angle);
+        for (int j = 0; j < 4; ++j) {
+            const double ox = (j == 1 || j == 2) ? half : -half;
+            const double oy = j >= 2 ? half : -half;
+            const double jx = rng.uniform(-0.15, 0.15) * half, jy = rng.uniform(-0.15, 0.15) * half;
+            dst[j] = cv::Point2f((float)(cx + c * ox - s * oy + jx), (float)(cy + s * ox + c * oy + jy));
+        }
+        const cv::Mat H = cv::getPerspectiveTransform(tplOuter, dst);
+        cv::perspectiveTransform(tplMarker, markerDst, H);
+
+        // Warp into the bounding box only, leaving the rest of the frame alone
+        const cv::Rect box = cv::boundingRect(dst) & cv::Rect(0, 0, size.width, size.height);
+        if (box.area() == 0) continue;
+        cv::Mat shift = (cv::Mat_<double>(3, 3) << 1, 0, -box.x, 0, 1, -box.y, 0, 0, 1);
+        cv::Mat roi = out(box);
+        cv::warpPerspective(bank_[id], roi, shift * H, box.size(), cv::INTER_LINEAR, cv::BORDER_TRANSPARENT);
+
+        SceneMarker m;
+        m.dict = dictId_;
+        m.id = id;
+        for (int j = 0; j < 4; ++j) m.corners[j] = markerDst[j];
+        truth.push_back(m);
+    }
+
+    const double sigma = rng.uniform(0.0, cfg_.maxBlurSigma);
+    if (sigma > 0.3) cv::GaussianBlur(out, out, cv::Size(0, 0), sigma);
+
+    // Uneven lighting: a bilinear gain field from four random corner values
+    cv::Mat field(2, 2, CV_32F);
+    for (int i = 0; i < 4; ++i) field.at<float>(i / 2, i % 2) = (float)rng.uniform(0.55, 1.15);
+    cv::resize(field, gain_, size, 0, 0, cv::INTER_LINEAR);
+    out.convertTo(work_, CV_32F);
+    cv::multiply(work_, gain_, work_);
+    if (cfg_.noiseSigma > 0) {
+        noise_.create(size, CV_32F);
+        rng.fill(noise_, cv::RNG::NORMAL, 0.0, cfg_.noiseSigma);
+        work_ += noise_;
+    }
+    work_.convertTo(out, CV_8U);
+}
+
+SyntheticFrameRing::SyntheticFrameRing(SyntheticScene& scene, int frames)
+    : frames_(std::max(1, frames)), truth_(frames_.size()) {
+    for (size_t i = 0; i < frames_.size(); ++i) scene.render(i, frames_[i], truth_[i]);
+}
+
+const cv::Mat& SyntheticFrameRing::next(const std::vector<SceneMarker>*& truth) {
+    const size_t i = next_;
+    next_ = (next_ + 1) % frames_.size();
+    truth = &truth_[i];
+    return frames_[i];
+}
+
+int countRecalled(const std::vector<SceneMarker>& truth, const std::vector<int>& dicts, const std::vector<int>& ids,
+                  const std::vector<std::vector<cv::Point2f>>& corners) {
+    int found = 0;
+    for (const SceneMarker& t : truth) {
+        const cv::Point2f center = (t.corners[0] + t.corners[1] + t.corners[2] + t.corners[3]) * 0.25f;
+        const cv::Point2f edge = t.corners[1] - t.corners[0];
+        const float tolerance2 = 0.25f * edge.dot(edge); // half a side
+        for (size_t i = 0; i < ids.size(); ++i) {
+            if (ids[i] != t.id || dicts[i] != t.dict) continue;
+            const std::vector<cv::Point2f>& c = corners[i];
+            const cv::Point2f d = (c[0] + c[1] + c[2] + c[3]) * 0.25f - center;
+            if (d.dot(d) <= tolerance2) {
+                ++found;
+                break;
+            }
+        }
+    }
+    return found;
+}
@@ -0,0 +1,65 @@
+// Synthetic benchmark input: frames with a known set of markers under random
+// perspective, blur, noise and lighting, rendered from a template bank built
+// once. The same seed always yields the same frames.
+
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/aruco.hpp>
+#include <cstdint>
+#include <vector>
+
+struct SceneConfig {
+    cv::Size size = cv::Size(1280, 720);
+    int markers = 8;           // per frame
+    int bankSize = 64;         // templates, ids 0..bankSize-1 (fewer if the dictionary is smaller)
+    int templatePx = 160;      // template side, quiet zone included
+    double minSidePx = 24.0;   // marker side on the frame
+    double maxSidePx = 220.0;
+    double maxBlurSigma = 1.2;
+    double noiseSigma = 4.0;   // grey levels
+    uint64_t seed = 1;
+};
+
+struct SceneMarker {
+    int dict;               // dictionary id, as Detections::dicts holds it
+    int id;
+    cv::Point2f corners[4]; // clockwise from the marker origin, as detectMarkers reports them
+};
+
+class SyntheticScene {
+public:
+    // Markers are drawn from dict, reported under dictionary id dictId
+    SyntheticScene(const SceneConfig& cfg, const cv::Ptr<cv::aruco::Dictionary>& dict, int dictId);
+
+    // Frame number n (CV_8UC1, reuses out) and the markers placed on it
+    void render(uint64_t n, cv::Mat& out, std::vector<SceneMarker>& truth);
+
+    const SceneConfig& config() const { return cfg_; }
+
+private:
+    SceneConfig cfg_;
+    std::vector<cv::Mat> bank_;  // CV_8UC1, templatePx square
+    int dictId_;
+    int quietPx_ = 0;            // white border around the marker inside a template
+    cv::Mat gain_, noise_, work_; // CV_32F per-frame scratch
+};
+
+// Fixed set of rendered frames handed out in a loop, so a benchmark measures
+// the detector and not the renderer or the disk
+class SyntheticFrameRing {
+public:
+    SyntheticFrameRing(SyntheticScene& scene, int frames);
+
+    // Next frame in the ring (a view, valid until the ring is destroyed)
+    const cv::Mat& next(const std::vector<SceneMarker>*& truth);
+
+private:
+    std::vector<cv::Mat> frames_;
+    std::vector<std::vector<SceneMarker>> truth_;
+    size_t next_ = 0;
+};
+
+// Truth markers found with the right dictionary and id near the right place
+int countRecalled(const std::vector<SceneMarker>& truth, const std::vector<int>& dicts, const std::vector<int>& ids,
+                  const std::vector<std::vector<cv::Point2f>>& corners);
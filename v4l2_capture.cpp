@@ -0,0 +1,222 @@
+#include "v4l2_capture.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+static int xioctl(int fd, unsigned long request, void* arg) {
+    int r;
+    do { r = ioctl(fd, request, arg); } while (r < 0 && errno == EINTR);
+    return r;
+}
+
+static uint32_t fourccFromString(const std::string& s) {
+    std::string f = (s + "    ").substr(0, 4);
+    return v4l2_fourcc(f[0], f[1], f[2], f[3]);
+}
+
+void V4l2BufferLease::release() {
+    if (!owner_) return;
+    owner_->requeue(index_);
+    owner_ = nullptr;
+    index_ = -1;
+}
+
+int V4l2BufferLease::dmabufFd() const {
+    return owner_ ? owner_->dmabufFd(index_) : -1;
+}
+
+bool V4l2Capture::fail(const std::string& what) {
+    error_ = what + ": " + std::strerror(errno);
+    close();
+    return false;
+}
+
+bool V4l2Capture::open(const std::string& device, int width, int height, const std::string& fourcc,
+                       int bufferCount, bool exportDmabuf) {
+    close();
+    error_.clear();
+    fd_ = ::open(device.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd_ < 0) return fail("open " + device);
+
+    v4l2_capability caps;
+    std::memset(&caps, 0, sizeof(caps));
+    if (xioctl(fd_, VIDIOC_QUERYCAP, &caps) < 0) return fail("VIDIOC_QUERYCAP");
+    if (!(caps.capabilities & V4L2_CAP_VIDEO_CAPTURE) || !(caps.capabilities & V4L2_CAP_STREAMING)) {
+        errno = ENOTSUP;
+        return fail(device + " is not a streaming capture device");
+    }
+
+    v4l2_format fmt;
+    std::memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width = width;
+    fmt.fmt.pix.height = height;
+    fmt.fmt.pix.pixelformat = fourccFromString(fourcc);
+    fmt.fmt.pix.field = V4L2_FIELD_NONE;
+    if (xioctl(fd_, VIDIOC_S_FMT, &fmt) < 0) return fail("VIDIOC_S_FMT");
+    pixfmt_ = fmt.fmt.pix.pixelformat;
+    if (pixfmt_ != V4L2_PIX_FMT_YUYV && pixfmt_ != V4L2_PIX_FMT_UYVY &&
+        pixfmt_ != V4L2_PIX_FMT_NV12 && pixfmt_ != V4L2_PIX_FMT_GREY) {
+        errno = ENOTSUP;
+        return fail("driver chose unsupported pixel format " + this->fourcc());
+    }
+    width_ = (int)fmt.fmt.pix.width;
+    height_ = (int)fmt.fmt.pix.height;
+    bytesPerLine_ = (int)fmt.fmt.pix.bytesperline;
+
+    v4l2_requestbuffers req;
+    std::memset(&req, 0, sizeof(req));
+    req.count = std::max(2, bufferCount);
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(fd_, VIDIOC_REQBUFS, &req) < 0) return fail("VIDIOC_REQBUFS");
+    if (req.count < 2) {
+        errno = ENOMEM;
+        return fail("VIDIOC_REQBUFS granted too few buffers");
+    }
+
+    buffers_.resize(req.count);
+    for (unsigned i = 0; i < req.count; ++i) {
+        v4l2_buffer buf;
+        std::memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        if (xioctl(fd_, VIDIOC_QUERYBUF, &buf) < 0) return fail("VIDIOC_QUERYBUF");
+        void* p = mmap(nullptr, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, buf.m.offset);
+        if (p == MAP_FAILED) return fail("mmap");
+        buffers_[i].start = p;
+        buffers_[i].length = buf.length;
+
+        if (exportDmabuf) {
+            v4l2_exportbuffer exp;
+            std::memset(&exp, 0, sizeof(exp));
+            exp.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            exp.index = i;
+            exp.flags = O_RDONLY | O_CLOEXEC;
+            if (xioctl(fd_, VIDIOC_EXPBUF, &exp) < 0) return fail("VIDIOC_EXPBUF");
+            buffers_[i].dmabufFd = exp.fd;
+        }
+
+        if (xioctl(fd_, VIDIOC_QBUF, &buf) < 0) return fail("VIDIOC_QBUF");
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        queued_ = (int)req.count;
+    }
+
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(fd_, VIDIOC_STREAMON, &type) < 0) return fail("VIDIOC_STREAMON");
+    streaming_ = true;
+    return true;
+}
+
+void V4l2Capture::close() {
+    if (fd_ < 0) return;
+    if (streaming_) {
+        v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        xioctl(fd_, VIDIOC_STREAMOFF, &type);
+        streaming_ = false;
+    }
+    for (Buffer& b : buffers_) {
+        if (b.dmabufFd >= 0) ::close(b.dmabufFd);
+        if (b.start) munmap(b.start, b.length);
+    }
+    buffers_.clear();
+    ::close(fd_);
+    fd_ = -1;
+    std::lock_guard<std::mutex> lock(queueMutex_);
+    queued_ = 0;
+}
+
+V4l2Capture::ReadStatus V4l2Capture::read(cv::Mat& view, V4l2BufferLease& lease, double& timestampMs,
+                                          int timeoutMs) {
+    lease.release(); // the caller is done with its previous buffer
+    if (fd_ < 0) return ReadStatus::Error;
+
+    {
+        // With no buffer queued poll fails at once and DQBUF says EAGAIN, so
+        // wait for the pipeline to hand one back instead of spinning
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        if (!requeued_.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this] { return queued_ > 0; }))
+            return ReadStatus::Timeout;
+    }
+
+    struct pollfd pfd = {fd_, POLLIN, 0};
+    int r = poll(&pfd, 1, timeoutMs);
+    if (r == 0 || (r < 0 && errno == EINTR)) return ReadStatus::Timeout;
+    if (r < 0) {
+        error_ = std::string("poll: ") + std::strerror(errno);
+        return ReadStatus::Error;
+    }
+
+    v4l2_buffer buf;
+    std::memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(fd_, VIDIOC_DQBUF, &buf) < 0) {
+        if (errno == EAGAIN) return ReadStatus::Timeout;
+        error_ = std::string("VIDIOC_DQBUF: ") + std::strerror(errno);
+        return ReadStatus::Error;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        --queued_;
+    }
+
+    uchar* data = static_cast<uchar*>(buffers_[buf.index].start);
+    switch (pixfmt_) {
+        case V4L2_PIX_FMT_YUYV:
+        case V4L2_PIX_FMT_UYVY:
+            view = cv::Mat(height_, width_, CV_8UC2, data, bytesPerLine_);
+            break;
+        case V4L2_PIX_FMT_NV12: // Y plane followed by interleaved UV rows
+            view = cv::Mat(height_ * 3 / 2, width_, CV_8UC1, data, bytesPerLine_);
+            break;
+        default: // GREY
+            view = cv::Mat(height_, width_, CV_8UC1, data, bytesPerLine_);
+            break;
+    }
+    // Only monotonic timestamps share a time base with steady_clock
+    if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+        timestampMs = buf.timestamp.tv_sec * 1000.0 + buf.timestamp.tv_usec / 1000.0;
+    else
+        timestampMs = 0.0;
+    lease = V4l2BufferLease(this, (int)buf.index);
+    return ReadStatus::Frame;
+}
+
+void V4l2Capture::requeue(int index) {
+    if (fd_ < 0 || index < 0 || index >= (int)buffers_.size()) return;
+    v4l2_buffer buf;
+    std::memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = (unsigned)index;
+    if (xioctl(fd_, VIDIOC_QBUF, &buf) < 0) return;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        ++queued_;
+    }
+    requeued_.notify_one();
+}
+
+std::string V4l2Capture::fourcc() const {
+    char c[5] = {(char)(pixfmt_ & 0xFF), (char)((pixfmt_ >> 8) & 0xFF),
+                 (char)((pixfmt_ >> 16) & 0xFF), (char)((pixfmt_ >> 24) & 0xFF), 0};
+    return c;
+}
+
+int V4l2Capture::dmabufFd(int index) const {
+    if (index < 0 || index >= (int)buffers_.size()) return -1;
+    return buffers_[index].dmabufFd;
+}
@@ -0,0 +1,102 @@
+// Native V4L2 capture: memory-mapped driver buffers handed out as cv::Mat
+// views, so frames reach the detector without being copied.
+
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class V4l2Capture;
+
+// Move-only handle on one dequeued driver buffer. The buffer goes back to the
+// driver queue when the lease is released (or destroyed); any cv::Mat view
+// over it must not be used after that.
+class V4l2BufferLease {
+public:
+    V4l2BufferLease() {}
+    V4l2BufferLease(V4l2Capture* owner, int index) : owner_(owner), index_(index) {}
+    V4l2BufferLease(V4l2BufferLease&& o) noexcept : owner_(o.owner_), index_(o.index_) {
+        o.owner_ = nullptr;
+        o.index_ = -1;
+    }
+    V4l2BufferLease& operator=(V4l2BufferLease&& o) noexcept {
+        if (this != &o) {
+            release();
+            owner_ = o.owner_;
+            index_ = o.index_;
+            o.owner_ = nullptr;
+            o.index_ = -1;
+        }
+        return *this;
+    }
+    V4l2BufferLease(const V4l2BufferLease&) = delete;
+    V4l2BufferLease& operator=(const V4l2BufferLease&) = delete;
+    ~V4l2BufferLease() { release(); }
+
+    void release();
+    bool active() const { return owner_ != nullptr; }
+    int index() const { return index_; }
+    int dmabufFd() const; // -1 unless the capture exported DMABUFs
+
+private:
+    V4l2Capture* owner_ = nullptr;
+    int index_ = -1;
+};
+
+class V4l2Capture {
+public:
+    enum class ReadStatus { Frame, Timeout, Error };
+
+    V4l2Capture() {}
+    V4l2Capture(const V4l2Capture&) = delete;
+    V4l2Capture& operator=(const V4l2Capture&) = delete;
+    ~V4l2Capture() { close(); }
+
+    // fourcc: YUYV, UYVY, NV12 or GREY. The driver may adjust width/height.
+    bool open(const std::string& device, int width, int height, const std::string& fourcc,
+              int bufferCount, bool exportDmabuf);
+    void close();
+    bool isOpened() const { return fd_ >= 0; }
+
+    // Wait up to timeoutMs for the next frame, or for a lease to come back
+    // when the pipeline holds every buffer. view becomes a header over the
+    // driver buffer held by lease; timestampMs is the driver timestamp on the
+    // CLOCK_MONOTONIC (std::chrono::steady_clock) time base, 0 if the driver
+    // stamps with another clock.
+    ReadStatus read(cv::Mat& view, V4l2BufferLease& lease, double& timestampMs, int timeoutMs = 1000);
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    std::string fourcc() const;
+    int bufferCount() const { return (int)buffers_.size(); }
+    int dmabufFd(int index) const;
+    const std::string& error() const { return error_; }
+
+private:
+    friend class V4l2BufferLease;
+    void requeue(int index);
+    bool fail(const std::string& what);
+
+    struct Buffer {
+        void* start = nullptr;
+        size_t length = 0;
+        int dmabufFd = -1;
+    };
+
+    int fd_ = -1;
+    int width_ = 0;
+    int height_ = 0;
+    int bytesPerLine_ = 0;
+    uint32_t pixfmt_ = 0;
+    bool streaming_ = false;
+    std::vector<Buffer> buffers_;
+    std::string error_;
+    // Buffers owned by the driver; leases are released from other threads
+    std::mutex queueMutex_;
+    std::condition_variable requeued_;
+    int queued_ = 0;
+};